@@ -0,0 +1,113 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "flat_map.h"
+#include "map.h"
+
+namespace {
+
+constexpr uint64_t kKeySpace = 1 << 20;
+
+// Zipfian sampler (s ~ 0.99) over [0, kKeySpace): a handful of keys absorb
+// most probes, mimicking the skewed production key mix.
+class Zipf {
+ public:
+  Zipf() {
+    cdf_.reserve(kBuckets);
+    double sum = 0;
+    for (uint64_t i = 1; i <= kBuckets; ++i) {
+      sum += 1.0 / static_cast<double>(i);
+      cdf_.push_back(sum);
+    }
+    for (double& c : cdf_) {
+      c /= sum;
+    }
+  }
+
+  uint64_t operator()(std::mt19937_64& rng) const {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    uint64_t rank = static_cast<uint64_t>(it - cdf_.begin());
+    // Spread each rank over its slice of the key space.
+    return rank * (kKeySpace / kBuckets) + rng() % (kKeySpace / kBuckets);
+  }
+
+ private:
+  static constexpr uint64_t kBuckets = 1024;
+  std::vector<double> cdf_;
+};
+
+Map<uint64_t, uint64_t>& PrefilledMap() {
+  static Map<uint64_t, uint64_t> map(kKeySpace);
+  static std::once_flag once;
+  std::call_once(once, [] {
+    for (uint64_t i = 0; i < kKeySpace; i += 2) {
+      map.Insert(i, i);
+    }
+  });
+  return map;
+}
+
+}  // namespace
+
+// 100% lookups, uniform keys, 50% hit rate.
+static void BM_MapReadHeavy(benchmark::State& state) {
+  auto& map = PrefilledMap();
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.Find(rng() % kKeySpace));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MapReadHeavy)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
+
+// Insert/erase pairs on thread-disjoint keys.
+static void BM_MapWriteHeavy(benchmark::State& state) {
+  static Map<uint64_t, uint64_t> map(kKeySpace);
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = kKeySpace + state.thread_index() * kKeySpace + rng() % kKeySpace;
+    map.Insert(key, 1);
+    map.Erase(key);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_MapWriteHeavy)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
+
+// 90% zipfian lookups / 10% zipfian upserts.
+static void BM_MapZipfMixed(benchmark::State& state) {
+  auto& map = PrefilledMap();
+  static const Zipf zipf;
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = zipf(rng);
+    if (rng() % 10 == 0) {
+      map.Insert(key, key, /*replace=*/true);
+    } else {
+      benchmark::DoNotOptimize(map.Find(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MapZipfMixed)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
+
+// Same read-heavy shape against the open-addressing variant.
+static void BM_FlatMapReadHeavy(benchmark::State& state) {
+  static FlatMap<uint64_t, uint64_t> map(kKeySpace * 2);
+  static std::once_flag once;
+  std::call_once(once, [] {
+    for (uint64_t i = 0; i < kKeySpace; i += 2) {
+      map.Insert(i, i);
+    }
+  });
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(map.Find(rng() % kKeySpace));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FlatMapReadHeavy)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
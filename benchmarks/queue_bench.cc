@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <thread>
+
+#include "bounded_queue.h"
+#include "pool_allocator.h"
+#include "queue.h"
+
+// Throughput: every thread pushes one value and pops one per iteration, so
+// the queue stays balanced and the number reflects a full produce/consume
+// round. Run with --benchmark_repetitions for percentiles.
+
+static void BM_QueuePushPop(benchmark::State& state) {
+  static Queue<uint64_t> q;
+  for (auto _ : state) {
+    q.Push(1);
+    benchmark::DoNotOptimize(q.TryPop());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueuePushPop)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
+
+static void BM_QueuePoolAllocPushPop(benchmark::State& state) {
+  static Queue<uint64_t, PoolAllocator> q;
+  for (auto _ : state) {
+    q.Push(1);
+    benchmark::DoNotOptimize(q.TryPop());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueuePoolAllocPushPop)
+    ->Threads(1)
+    ->Threads(2)
+    ->Threads(4)
+    ->Threads(8);
+
+static void BM_BoundedQueuePushPop(benchmark::State& state) {
+  static BoundedQueue<uint64_t, 1 << 16> q;
+  for (auto _ : state) {
+    q.Push(1);
+    benchmark::DoNotOptimize(q.TryPop());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BoundedQueuePushPop)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
+
+static void BM_QueueBatchPushPop(benchmark::State& state) {
+  static Queue<uint64_t> q;
+  const uint64_t batch = state.range(0);
+  std::vector<uint64_t> values(batch, 1);
+  for (auto _ : state) {
+    q.PushBatch(values.begin(), values.end());
+    benchmark::DoNotOptimize(q.PopBatch(batch));
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_QueueBatchPushPop)->Arg(16)->Arg(64)->Arg(256)->Threads(2);
+
+// Queue::WaitAndPop hands back an optional, BoundedQueue's a plain value.
+static int Unwrap(int v) { return v; }
+static int Unwrap(std::optional<int> v) { return *v; }
+
+// Wakeup latency: ping-pong between two queues with an echo thread; one
+// iteration is two WaitAndPop wakeups, so halve the reported time per wakeup.
+template <typename Q>
+static void WakeupPingPong(benchmark::State& state) {
+  Q ping;
+  Q pong;
+  std::thread echo([&] {
+    for (;;) {
+      int v = Unwrap(ping.WaitAndPop());
+      pong.Push(v);
+      if (v == 0) {
+        return;
+      }
+    }
+  });
+  for (auto _ : state) {
+    ping.Push(1);
+    benchmark::DoNotOptimize(pong.WaitAndPop());
+  }
+  ping.Push(0);
+  (void)pong.WaitAndPop();
+  echo.join();
+}
+
+static void BM_QueueWakeupLatency(benchmark::State& state) {
+  WakeupPingPong<Queue<int>>(state);
+}
+BENCHMARK(BM_QueueWakeupLatency);
+
+static void BM_BoundedQueueWakeupLatency(benchmark::State& state) {
+  WakeupPingPong<BoundedQueue<int, 1024>>(state);
+}
+BENCHMARK(BM_BoundedQueueWakeupLatency);
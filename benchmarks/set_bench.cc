@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+#include "set.h"
+
+namespace {
+
+constexpr uint64_t kKeySpace = 1 << 20;
+
+Set<uint64_t>& PrefilledSet() {
+  static Set<uint64_t> set(kKeySpace);
+  static std::once_flag once;
+  std::call_once(once, [] {
+    for (uint64_t i = 0; i < kKeySpace; i += 2) {
+      set.Insert(i);
+    }
+  });
+  return set;
+}
+
+}  // namespace
+
+// 100% membership checks, uniform keys, 50% hit rate.
+static void BM_SetContains(benchmark::State& state) {
+  auto& set = PrefilledSet();
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.Contains(rng() % kKeySpace));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SetContains)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
+
+// Insert/erase pairs on thread-disjoint keys.
+static void BM_SetInsertErase(benchmark::State& state) {
+  static Set<uint64_t> set(kKeySpace);
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = kKeySpace + state.thread_index() * kKeySpace + rng() % kKeySpace;
+    set.Insert(key);
+    set.Erase(key);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_SetInsertErase)->Threads(1)->Threads(2)->Threads(4)->Threads(8);
@@ -0,0 +1,126 @@
+#ifndef THREADSAFE__BOUNDED_QUEUE_H_
+#define THREADSAFE__BOUNDED_QUEUE_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+
+// Bounded MPMC queue over a fixed ring of cells with per-cell sequence
+// counters (Vyukov scheme). No locks and no allocation after construction;
+// a full queue rejects TryPush instead of growing.
+template <typename T, uint64_t Capacity>
+class BoundedQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  struct Cell {
+    std::atomic<uint64_t> seq;
+    T value;
+  };
+
+ public:
+  BoundedQueue() {
+    for (uint64_t i = 0; i < Capacity; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Cells hold atomics, so the queue is pinned in place.
+  BoundedQueue(const BoundedQueue& other) = delete;
+  BoundedQueue& operator=(const BoundedQueue& other) = delete;
+  BoundedQueue(BoundedQueue&& other) = delete;
+  BoundedQueue& operator=(BoundedQueue&& other) = delete;
+
+  bool TryPush(T value);
+  void Push(T value);
+  std::optional<T> TryPop();
+  T WaitAndPop();
+  [[nodiscard]] bool Empty() const;
+
+ private:
+  static constexpr uint64_t kMask = Capacity - 1;
+  static constexpr int kSpinLimit = 128;
+
+  alignas(64) std::array<Cell, Capacity> cells_;
+  alignas(64) std::atomic<uint64_t> head_ = 0;
+  alignas(64) std::atomic<uint64_t> tail_ = 0;
+};
+
+template <typename T, uint64_t Capacity>
+bool BoundedQueue<T, Capacity>::TryPush(T value) {
+  uint64_t pos = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell& cell = cells_[pos & kMask];
+    uint64_t seq = cell.seq.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        cell.value = std::move(value);
+        cell.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // Cell still holds an unpopped value from the previous lap: full.
+      return false;
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T, uint64_t Capacity>
+void BoundedQueue<T, Capacity>::Push(T value) {
+  int spins = 0;
+  while (!TryPush(std::move(value))) {
+    if (++spins > kSpinLimit) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename T, uint64_t Capacity>
+std::optional<T> BoundedQueue<T, Capacity>::TryPop() {
+  uint64_t pos = head_.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell& cell = cells_[pos & kMask];
+    uint64_t seq = cell.seq.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos + 1);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        std::optional<T> out{std::move(cell.value)};
+        cell.seq.store(pos + Capacity, std::memory_order_release);
+        return out;
+      }
+    } else if (diff < 0) {
+      return std::nullopt;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T, uint64_t Capacity>
+T BoundedQueue<T, Capacity>::WaitAndPop() {
+  int spins = 0;
+  for (;;) {
+    if (auto val = TryPop()) {
+      return std::move(*val);
+    }
+    if (++spins > kSpinLimit) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename T, uint64_t Capacity>
+bool BoundedQueue<T, Capacity>::Empty() const {
+  return head_.load(std::memory_order_acquire) ==
+         tail_.load(std::memory_order_acquire);
+}
+
+#endif  // THREADSAFE__BOUNDED_QUEUE_H_
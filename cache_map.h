@@ -0,0 +1,203 @@
+#ifndef THREADSAFE__CACHE_MAP_H_
+#define THREADSAFE__CACHE_MAP_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+#include "pool_allocator.h"
+
+// Bounded-memory cache over Map: every entry carries an expiry deadline and
+// a last-access stamp. Expired entries are dropped lazily by the access
+// that finds them and by a sweep amortized over every kSweepEvery
+// operations; when a max entry count is set, inserts that overflow it evict
+// the least recently used entries in a batch. Size() counts entries that
+// have expired but not been swept yet.
+template <typename Key, typename Value, typename Hash = FastHash,
+          template <typename> typename Alloc = DefaultAllocator>
+class CacheMap {
+  // Relaxed-atomic access stamp with value semantics, so entries stay
+  // movable while reads may bump the stamp under the node's shared lock.
+  struct Stamp {
+    explicit Stamp(uint64_t ns) : ns(ns) {}
+    Stamp(const Stamp& other) : ns(other.Get()) {}
+    Stamp& operator=(const Stamp& other) {
+      ns.store(other.Get(), std::memory_order_relaxed);
+      return *this;
+    }
+    [[nodiscard]] uint64_t Get() const {
+      return ns.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> ns;
+  };
+
+  struct Stamped {
+    Value val;
+    // Steady-clock nanoseconds; 0 = never expires.
+    uint64_t expires_at;
+    Stamp last_access;
+  };
+
+ public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr std::chrono::nanoseconds kNoTtl{0};
+
+  // max_entries = 0 leaves the count unbounded; ttl = kNoTtl means entries
+  // only leave through Erase or the LRU limit.
+  explicit CacheMap(uint64_t max_entries = 0,
+                    std::chrono::nanoseconds ttl = kNoTtl)
+      : max_entries_(max_entries), ttl_(ttl) {}
+
+  // Misses on expired entries (and erases them); hits refresh the
+  // last-access stamp.
+  std::optional<Value> Find(const Key& key);
+  // Inserts or overwrites, stamping with the cache-wide ttl (or the given
+  // one); enforces the entry limit.
+  void Insert(const Key& key, Value val);
+  void Insert(const Key& key, Value val, std::chrono::nanoseconds ttl);
+  bool Erase(const Key& key) { return map_.Erase(key); }
+  [[nodiscard]] uint64_t Size() const { return map_.Size(); }
+
+  // Drops every expired entry now; the amortized path calls this every
+  // kSweepEvery operations.
+  void Sweep() { SweepExpired(NowNs()); }
+
+ private:
+  static constexpr uint64_t kSweepEvery = 1024;
+  // Batch eviction target: max - max/kEvictSlack, so one scan pays for
+  // many inserts.
+  static constexpr uint64_t kEvictSlack = 16;
+
+  static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+  }
+  uint64_t DeadlineFor(uint64_t now, std::chrono::nanoseconds ttl) const {
+    return ttl == kNoTtl ? 0 : now + ttl.count();
+  }
+  static bool Expired(const Stamped& entry, uint64_t now) {
+    return entry.expires_at != 0 && entry.expires_at <= now;
+  }
+
+  void MaybeSweep(uint64_t now);
+  void SweepExpired(uint64_t now);
+  void EnforceLimit(uint64_t now);
+
+  Map<Key, Stamped, Hash, Alloc> map_;
+  uint64_t max_entries_;
+  std::chrono::nanoseconds ttl_;
+  std::atomic<uint64_t> ops_ = 0;
+  // One sweeper/evictor at a time; everyone else moves on.
+  std::atomic<bool> sweeping_ = false;
+};
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc>
+std::optional<Value> CacheMap<Key, Value, Hash, Alloc>::Find(const Key& key) {
+  const uint64_t now = NowNs();
+  std::optional<Value> out;
+  bool expired = false;
+  map_.ApplySoft(key, [&](Stamped& entry) {
+    if (Expired(entry, now)) {
+      expired = true;
+      return;
+    }
+    entry.last_access.ns.store(now, std::memory_order_relaxed);
+    out = entry.val;
+  });
+  if (expired) {
+    map_.Erase(key);
+  }
+  MaybeSweep(now);
+  return out;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc>
+void CacheMap<Key, Value, Hash, Alloc>::Insert(const Key& key, Value val) {
+  Insert(key, std::move(val), ttl_);
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc>
+void CacheMap<Key, Value, Hash, Alloc>::Insert(const Key& key, Value val,
+                                               std::chrono::nanoseconds ttl) {
+  const uint64_t now = NowNs();
+  Stamped entry{std::move(val), DeadlineFor(now, ttl), Stamp(now)};
+  // Emplace consumes entry only when the key was absent; on a duplicate,
+  // overwrite under the node's writer lock (Upsert's insert branch covers
+  // a concurrent erase, which is why it gets a copy).
+  if (!map_.Emplace(key, std::move(entry))) {
+    map_.Upsert(
+        key, [&entry](Stamped& cur) { cur = std::move(entry); }, entry);
+  }
+  MaybeSweep(now);
+  EnforceLimit(now);
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc>
+void CacheMap<Key, Value, Hash, Alloc>::MaybeSweep(uint64_t now) {
+  if (ops_.fetch_add(1, std::memory_order_relaxed) % kSweepEvery !=
+      kSweepEvery - 1) {
+    return;
+  }
+  if (sweeping_.exchange(true)) {
+    return;
+  }
+  SweepExpired(now);
+  sweeping_.store(false);
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc>
+void CacheMap<Key, Value, Hash, Alloc>::SweepExpired(uint64_t now) {
+  std::vector<Key> dead;
+  map_.ForEach([&](const Key& key, Stamped& entry) {
+    if (Expired(entry, now)) {
+      dead.push_back(key);
+    }
+  });
+  for (const Key& key : dead) {
+    map_.Erase(key);
+  }
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc>
+void CacheMap<Key, Value, Hash, Alloc>::EnforceLimit(uint64_t now) {
+  if (max_entries_ == 0 || map_.Size() <= max_entries_) {
+    return;
+  }
+  if (sweeping_.exchange(true)) {
+    return;
+  }
+  SweepExpired(now);
+  const uint64_t target = max_entries_ - max_entries_ / kEvictSlack;
+  if (map_.Size() > target) {
+    // Oldest last-access stamps go first.
+    std::vector<std::pair<uint64_t, Key>> entries;
+    entries.reserve(map_.Size());
+    map_.ForEach([&](const Key& key, Stamped& entry) {
+      entries.emplace_back(entry.last_access.Get(), key);
+    });
+    if (entries.size() > target) {
+      const uint64_t excess = entries.size() - target;
+      std::nth_element(entries.begin(), entries.begin() + excess,
+                       entries.end());
+      for (uint64_t i = 0; i < excess; ++i) {
+        map_.Erase(entries[i].second);
+      }
+    }
+  }
+  sweeping_.store(false);
+}
+
+#endif  // THREADSAFE__CACHE_MAP_H_
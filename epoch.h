@@ -0,0 +1,162 @@
+#ifndef THREADSAFE__EPOCH_H_
+#define THREADSAFE__EPOCH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation for read-side-lock-free containers. Readers wrap a
+// traversal in a Guard; writers hand unlinked nodes to Retire instead of
+// deleting them. A retired node is freed only once every thread that was
+// pinned at retirement has unpinned, so a reader may keep following pointers
+// through concurrently erased nodes without touching freed memory.
+//
+// The registry is process-wide and shared by all containers. Pinning is two
+// uncontended atomics on a thread-private cache line; Retire takes a mutex,
+// which keeps the cost on the write side where locks are already taken.
+class Epoch {
+  static constexpr uint64_t kIdle = UINT64_MAX;
+  static constexpr uint64_t kMaxThreads = 256;
+  // Retired nodes buffered before a reclaim pass is attempted.
+  static constexpr uint64_t kRetireBatch = 64;
+
+  struct Slot {
+    Slot() : epoch(kIdle), used(false) {}
+
+    alignas(64) std::atomic<uint64_t> epoch;
+    std::atomic<bool> used;
+    // Pin nesting count; only ever touched by the owning thread.
+    uint64_t depth = 0;
+  };
+
+ public:
+  class Guard {
+   public:
+    Guard(const Guard& other) = delete;
+    Guard& operator=(const Guard& other) = delete;
+    Guard(Guard&& other) = delete;
+    Guard& operator=(Guard&& other) = delete;
+    ~Guard() {
+      if (--slot_->depth == 0) {
+        slot_->epoch.store(kIdle);
+      }
+    }
+
+   private:
+    friend class Epoch;
+    explicit Guard(Slot* slot) : slot_(slot) {}
+
+    Slot* slot_;
+  };
+
+  // Pins the calling thread at the current epoch until the Guard dies.
+  // Guards nest: an inner Pin (say, a container lookup from a ForEach
+  // callback) rides the outer pin, and only the outermost unpin clears
+  // the slot — so a callback calling back into a container cannot strip
+  // the traversal around it of its protection.
+  static Guard Pin() {
+    Slot& slot = LocalSlot();
+    if (slot.depth++ > 0) {
+      return Guard(&slot);
+    }
+    // Re-announce until the published epoch is confirmed current, so an
+    // advance cannot slip in between reading and announcing it.
+    uint64_t epoch = global_.load();
+    for (;;) {
+      slot.epoch.store(epoch);
+      uint64_t now = global_.load();
+      if (now == epoch) {
+        break;
+      }
+      epoch = now;
+    }
+    return Guard(&slot);
+  }
+
+  // Queues ptr to be passed to deleter once no pinned thread can still be
+  // holding it. Safe to call for nodes unlinked under the caller's locks.
+  static void Retire(void* ptr, void (*deleter)(void*)) {
+    std::scoped_lock lk(retired_m_);
+    retired_.items.push_back({ptr, deleter, global_.load()});
+    if (retired_.items.size() >= kRetireBatch) {
+      TryAdvance();
+      ReclaimLocked();
+    }
+  }
+
+ private:
+  struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch;
+  };
+  // Frees leftovers at process exit, when no reader can be live.
+  struct RetiredList {
+    ~RetiredList() {
+      for (auto& r : items) {
+        r.deleter(r.ptr);
+      }
+    }
+
+    std::vector<Retired> items;
+  };
+
+  static Slot& LocalSlot() {
+    struct Handle {
+      Handle() {
+        for (;;) {
+          for (auto& s : slots_) {
+            if (!s.used.load() && !s.used.exchange(true)) {
+              slot = &s;
+              return;
+            }
+          }
+          // More live threads than slots; spin until one exits.
+        }
+      }
+      ~Handle() {
+        slot->epoch.store(kIdle);
+        slot->used.store(false);
+      }
+
+      Slot* slot = nullptr;
+    };
+    thread_local Handle handle;
+    return *handle.slot;
+  }
+
+  // Bumps the global epoch if every pinned thread has caught up to it; a
+  // thread still pinned at an older epoch holds the advance back.
+  static void TryAdvance() {
+    uint64_t epoch = global_.load();
+    for (auto& s : slots_) {
+      uint64_t seen = s.epoch.load();
+      if (seen != kIdle && seen != epoch) {
+        return;
+      }
+    }
+    global_.compare_exchange_strong(epoch, epoch + 1);
+  }
+
+  // Frees entries retired at least two epochs ago: each advance past an
+  // entry's epoch required every pinned thread to have re-pinned since, so
+  // no thread can still hold a pointer from before the unlink.
+  static void ReclaimLocked() {
+    uint64_t current = global_.load();
+    std::erase_if(retired_.items, [current](const Retired& r) {
+      if (r.epoch + 2 > current) {
+        return false;
+      }
+      r.deleter(r.ptr);
+      return true;
+    });
+  }
+
+  static inline std::atomic<uint64_t> global_ = 0;
+  static inline Slot slots_[kMaxThreads];
+  static inline std::mutex retired_m_;
+  static inline RetiredList retired_;
+};
+
+#endif  // THREADSAFE__EPOCH_H_
@@ -0,0 +1,243 @@
+#ifndef THREADSAFE__FLAT_MAP_H_
+#define THREADSAFE__FLAT_MAP_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include "flat_probe.h"
+
+// Open-addressing hash map for trivially-copyable keys and values. Entries
+// live in contiguous slot arrays with a one-byte control per slot (see
+// flat_probe.h): probes compare 16 control bytes per SSE2 op, touch no
+// per-node locks and chase no pointers. The table is split into
+// power-of-two lock stripes; a key's probe sequence stays inside one stripe,
+// which also lets a full stripe rehash privately under its own writer lock
+// while the other stripes keep serving.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatMap {
+  static_assert(std::is_trivially_copyable_v<Key>);
+  static_assert(std::is_trivially_copyable_v<Value>);
+
+  struct Slot {
+    Key key;
+    Value val;
+  };
+
+  struct Stripe {
+    mutable std::shared_mutex m;
+    std::vector<uint8_t> states;
+    std::vector<Slot> slots;
+    // full + tombstone slots; bounds the probe length.
+    uint64_t used = 0;
+  };
+
+ public:
+  explicit FlatMap(uint64_t capacity = kDefaultCapacity);
+  ~FlatMap() = default;
+
+  FlatMap(const FlatMap& other) = delete;
+  FlatMap& operator=(const FlatMap& other) = delete;
+
+  std::optional<Value> operator[](const Key& key) const;
+  std::optional<Value> Find(const Key& key) const;
+  [[nodiscard]] bool Contains(const Key& key) const;
+
+  bool Insert(const Key& key, const Value& value, bool replace = false);
+  bool Erase(const Key& key);
+
+  [[nodiscard]] uint64_t Size() const;
+
+ private:
+  static constexpr uint64_t kDefaultCapacity = 1 << 16;
+  static constexpr uint64_t kStripeBits = 6;
+  static constexpr uint64_t kNumStripes = 1 << kStripeBits;
+  static constexpr uint64_t kMinStripeCapacity = kFlatGroupSize;
+
+  static uint64_t MixedHash(const Hash& hash, const Key& key) {
+    return FlatMixHash(hash(key));
+  }
+
+  static uint64_t StripeIndex(uint64_t h) { return h >> (64 - kStripeBits); }
+  // Probing walks 16-slot groups: start at the group holding h's home slot
+  // and advance a group at a time, so insertion and lookup agree on the
+  // search order (stripe capacity is a power of two and a multiple of 16).
+  static uint64_t FirstGroup(uint64_t h, uint64_t mask) {
+    return h & mask & ~(kFlatGroupSize - 1);
+  }
+
+  static uint64_t NextPowerOfTwo(uint64_t x);
+  // Rebuilds the stripe with the given capacity, dropping tombstones.
+  // Caller holds the stripe's writer lock.
+  void Rehash(Stripe& stripe, uint64_t new_capacity);
+
+  std::array<Stripe, kNumStripes> stripes_;
+  std::atomic<uint64_t> count_ = 0;
+  Hash hash_;
+};
+
+template <typename Key, typename Value, typename Hash>
+FlatMap<Key, Value, Hash>::FlatMap(uint64_t capacity) {
+  uint64_t stripe_capacity =
+      NextPowerOfTwo(std::max(capacity / kNumStripes, kMinStripeCapacity));
+  for (auto& stripe : stripes_) {
+    stripe.states.assign(stripe_capacity, kFlatEmpty);
+    stripe.slots.resize(stripe_capacity);
+  }
+}
+
+template <typename Key, typename Value, typename Hash>
+std::optional<Value> FlatMap<Key, Value, Hash>::operator[](
+    const Key& key) const {
+  uint64_t h = MixedHash(hash_, key);
+  const uint8_t h2 = FlatH2(h);
+  const Stripe& stripe = stripes_[StripeIndex(h)];
+  std::shared_lock lk(stripe.m);
+  uint64_t mask = stripe.states.size() - 1;
+  for (uint64_t g = FirstGroup(h, mask);; g = (g + kFlatGroupSize) & mask) {
+    FlatGroup group(stripe.states.data() + g);
+    for (uint32_t m = group.Match(h2); m != 0; m &= m - 1) {
+      uint64_t i = g + std::countr_zero(m);
+      if (stripe.slots[i].key == key) {
+        return stripe.slots[i].val;
+      }
+    }
+    if (group.MatchEmpty() != 0) {
+      return std::nullopt;
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Hash>
+std::optional<Value> FlatMap<Key, Value, Hash>::Find(const Key& key) const {
+  return this->operator[](key);
+}
+
+template <typename Key, typename Value, typename Hash>
+bool FlatMap<Key, Value, Hash>::Contains(const Key& key) const {
+  return this->operator[](key).has_value();
+}
+
+template <typename Key, typename Value, typename Hash>
+bool FlatMap<Key, Value, Hash>::Insert(const Key& key, const Value& value,
+                                       bool replace) {
+  uint64_t h = MixedHash(hash_, key);
+  const uint8_t h2 = FlatH2(h);
+  Stripe& stripe = stripes_[StripeIndex(h)];
+  std::unique_lock lk(stripe.m);
+  // Keep load (incl. tombstones) under 7/8; double only when genuinely full,
+  // otherwise rehash in place to shed tombstones.
+  if ((stripe.used + 1) * 8 > stripe.states.size() * 7) {
+    uint64_t full = 0;
+    for (uint8_t state : stripe.states) {
+      full += (state & 0x80) == 0;
+    }
+    Rehash(stripe, full * 8 > stripe.states.size() * 5 ? stripe.states.size() * 2
+                                                       : stripe.states.size());
+  }
+  uint64_t mask = stripe.states.size() - 1;
+  uint64_t insert_at = stripe.states.size();
+  for (uint64_t g = FirstGroup(h, mask);; g = (g + kFlatGroupSize) & mask) {
+    FlatGroup group(stripe.states.data() + g);
+    for (uint32_t m = group.Match(h2); m != 0; m &= m - 1) {
+      uint64_t i = g + std::countr_zero(m);
+      if (stripe.slots[i].key == key) {
+        if (!replace) {
+          return false;
+        }
+        stripe.slots[i].val = value;
+        return true;
+      }
+    }
+    if (insert_at == stripe.states.size()) {
+      // First tombstone or empty along the probe is the insertion point.
+      uint32_t non_full = group.MatchNonFull();
+      if (non_full != 0) {
+        insert_at = g + std::countr_zero(non_full);
+      }
+    }
+    if (group.MatchEmpty() != 0) {
+      break;
+    }
+  }
+  if (stripe.states[insert_at] == kFlatEmpty) {
+    ++stripe.used;
+  }
+  stripe.states[insert_at] = h2;
+  stripe.slots[insert_at] = Slot{key, value};
+  ++count_;
+  return true;
+}
+
+template <typename Key, typename Value, typename Hash>
+bool FlatMap<Key, Value, Hash>::Erase(const Key& key) {
+  uint64_t h = MixedHash(hash_, key);
+  const uint8_t h2 = FlatH2(h);
+  Stripe& stripe = stripes_[StripeIndex(h)];
+  std::unique_lock lk(stripe.m);
+  uint64_t mask = stripe.states.size() - 1;
+  for (uint64_t g = FirstGroup(h, mask);; g = (g + kFlatGroupSize) & mask) {
+    FlatGroup group(stripe.states.data() + g);
+    for (uint32_t m = group.Match(h2); m != 0; m &= m - 1) {
+      uint64_t i = g + std::countr_zero(m);
+      if (stripe.slots[i].key == key) {
+        stripe.states[i] = kFlatTombstone;
+        --count_;
+        return true;
+      }
+    }
+    if (group.MatchEmpty() != 0) {
+      return false;
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Hash>
+uint64_t FlatMap<Key, Value, Hash>::Size() const {
+  return count_;
+}
+
+template <typename Key, typename Value, typename Hash>
+uint64_t FlatMap<Key, Value, Hash>::NextPowerOfTwo(uint64_t x) {
+  uint64_t out = 1;
+  while (out < x) {
+    out *= 2;
+  }
+  return out;
+}
+
+template <typename Key, typename Value, typename Hash>
+void FlatMap<Key, Value, Hash>::Rehash(Stripe& stripe, uint64_t new_capacity) {
+  std::vector<uint8_t> old_states(new_capacity, kFlatEmpty);
+  std::vector<Slot> old_slots(new_capacity);
+  old_states.swap(stripe.states);
+  old_slots.swap(stripe.slots);
+  stripe.used = 0;
+  uint64_t mask = stripe.states.size() - 1;
+  for (uint64_t i = 0; i < old_states.size(); ++i) {
+    if ((old_states[i] & 0x80) != 0) {
+      continue;
+    }
+    uint64_t h = MixedHash(hash_, old_slots[i].key);
+    // Same group walk as the probes, so lookups find what we place here.
+    for (uint64_t g = FirstGroup(h, mask);; g = (g + kFlatGroupSize) & mask) {
+      uint32_t empty = FlatGroup(stripe.states.data() + g).MatchEmpty();
+      if (empty != 0) {
+        uint64_t j = g + std::countr_zero(empty);
+        stripe.states[j] = FlatH2(h);
+        stripe.slots[j] = old_slots[i];
+        ++stripe.used;
+        break;
+      }
+    }
+  }
+}
+
+#endif  // THREADSAFE__FLAT_MAP_H_
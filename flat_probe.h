@@ -0,0 +1,72 @@
+#ifndef THREADSAFE__FLAT_PROBE_H_
+#define THREADSAFE__FLAT_PROBE_H_
+
+#include <bit>
+#include <cstdint>
+
+#include "hash.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Swiss-table style control bytes shared by the flat containers: a full
+// slot's byte holds the low 7 bits of the hash (high bit clear), empty and
+// tombstone have it set, so one 16-byte group compare finds every candidate
+// slot — and every empty — per instruction. Without SSE2 the group degrades
+// to a scalar loop over the same bytes.
+
+inline constexpr uint8_t kFlatEmpty = 0x80;
+inline constexpr uint8_t kFlatTombstone = 0xFE;
+inline constexpr uint64_t kFlatGroupSize = 16;
+
+constexpr uint8_t FlatH2(uint64_t h) { return h & 0x7F; }
+
+// Open addressing needs well-spread bits even when the user hash is weak
+// (libstdc++ std::hash over integers is the identity), so finalize with a
+// splitmix64 round before deriving indices and control bytes.
+constexpr uint64_t FlatMixHash(uint64_t h) { return MixHash64(h); }
+
+// One 16-byte window of control bytes; Match results are bitmasks indexed
+// by slot-within-group (use std::countr_zero to walk them).
+class FlatGroup {
+ public:
+#if defined(__SSE2__)
+  explicit FlatGroup(const uint8_t* ctrl)
+      : bytes_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+  uint32_t Match(uint8_t byte) const {
+    return _mm_movemask_epi8(
+        _mm_cmpeq_epi8(bytes_, _mm_set1_epi8(static_cast<char>(byte))));
+  }
+  // Empty or tombstone slots: exactly the bytes with the high bit set.
+  uint32_t MatchNonFull() const { return _mm_movemask_epi8(bytes_); }
+  uint32_t MatchEmpty() const { return Match(kFlatEmpty); }
+
+ private:
+  __m128i bytes_;
+#else
+  explicit FlatGroup(const uint8_t* ctrl) : ctrl_(ctrl) {}
+
+  uint32_t Match(uint8_t byte) const {
+    uint32_t out = 0;
+    for (uint64_t i = 0; i < kFlatGroupSize; ++i) {
+      out |= uint32_t{ctrl_[i] == byte} << i;
+    }
+    return out;
+  }
+  uint32_t MatchNonFull() const {
+    uint32_t out = 0;
+    for (uint64_t i = 0; i < kFlatGroupSize; ++i) {
+      out |= uint32_t{(ctrl_[i] & 0x80) != 0} << i;
+    }
+    return out;
+  }
+  uint32_t MatchEmpty() const { return Match(kFlatEmpty); }
+
+ private:
+  const uint8_t* ctrl_;
+#endif
+};
+
+#endif  // THREADSAFE__FLAT_PROBE_H_
@@ -0,0 +1,97 @@
+#ifndef THREADSAFE__HASH_H_
+#define THREADSAFE__HASH_H_
+
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Satisfied by probe types the Hash functor hashes directly and that compare
+// against the stored key — std::string_view against a
+// Map<std::string, V, StringHash>, for instance. Gated on the functor
+// declaring is_transparent (as the standard containers do) so that probes
+// which are merely convertible to Key keep taking the exact-Key overload and
+// convert once, instead of once per comparison.
+template <typename K, typename Stored, typename Hash>
+concept HashableAs =
+    requires(const Hash& hash, const K& probe, const Stored& stored) {
+      typename Hash::is_transparent;
+      { hash(probe) } -> std::convertible_to<uint64_t>;
+      { stored == probe } -> std::convertible_to<bool>;
+    };
+
+// Transparent hash for string keys: lets string_view and char* probes hash
+// without building a std::string first.
+struct StringHash {
+  using is_transparent = void;
+
+  uint64_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
+// splitmix64 finalizer: full avalanche (every input bit flips about half
+// the output bits), so high and low output bits are equally usable for
+// index derivation.
+constexpr uint64_t MixHash64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Lemire's fastrange: maps h onto [0, n) with one multiply instead of the
+// ~20-cycle division of h % n. Consumes the HIGH bits of h, so h must be
+// well mixed — FastHash is; libstdc++'s std::hash over integers (the
+// identity) is not.
+constexpr uint64_t FastRange(uint64_t h, uint64_t n) {
+  return static_cast<uint64_t>((static_cast<unsigned __int128>(h) * n) >> 64);
+}
+
+// Bytewise companion to MixHash64: one mix round per 8-byte lane plus a
+// length-salted seed. Not cryptographic, just fast and well spread.
+inline uint64_t HashBytes(const void* data, uint64_t len) {
+  const auto* p = static_cast<const unsigned char*>(data);
+  uint64_t h = MixHash64(0x2545f4914f6cdd1dULL ^ len);
+  while (len >= 8) {
+    uint64_t lane;
+    std::memcpy(&lane, p, 8);
+    h = MixHash64(h ^ lane);
+    p += 8;
+    len -= 8;
+  }
+  if (len > 0) {
+    uint64_t lane = 0;
+    std::memcpy(&lane, p, len);
+    h = MixHash64(h ^ lane);
+  }
+  return h;
+}
+
+// Library-default Hash: avalanching integer mixing and bytewise string
+// hashing, transparent so string_view and char* probes hash without
+// materializing a Key. Everything else falls back to a mixed std::hash.
+// The containers index buckets with FastRange, which needs exactly this
+// kind of spread; sequential-ID keys under the identity std::hash would
+// otherwise pile into adjacent buckets.
+struct FastHash {
+  using is_transparent = void;
+
+  constexpr uint64_t operator()(std::integral auto x) const {
+    return MixHash64(static_cast<uint64_t>(x));
+  }
+  uint64_t operator()(std::string_view s) const {
+    return HashBytes(s.data(), s.size());
+  }
+  template <typename T>
+    requires(!std::integral<T> &&
+             !std::convertible_to<const T&, std::string_view>)
+  uint64_t operator()(const T& value) const {
+    return MixHash64(std::hash<T>{}(value));
+  }
+};
+
+#endif  // THREADSAFE__HASH_H_
@@ -1,299 +1,1306 @@
 #ifndef THREADSAFE__MAP_H_
 #define THREADSAFE__MAP_H_
 
+#include <algorithm>
 #include <atomic>
+#include <fstream>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-template <typename Key, typename Value, typename Hash = std::hash<Key>>
+#include "epoch.h"
+#include "hash.h"
+#include "lock_policy.h"
+#include "pool_allocator.h"
+#include "sharded_counter.h"
+#include "snapshot.h"
+
+// Read-mostly map: Find/Contains/ApplySoft walk the chains with plain atomic
+// loads under an epoch guard and take no locks (Find and ApplySoft take one
+// shared node lock at the matched node, to copy or mutate the value).
+// Insert/Erase and friends serialize on the bucket's writer lock; erased
+// nodes are handed to the epoch system so in-flight readers can finish
+// walking through them.
+//
+// The locking scheme is a compile-time policy (see lock_policy.h). The
+// default keeps the per-node value locks described above; with a
+// bucket-only policy nodes carry no lock and value access rides the bucket
+// lock instead — Find and ApplySoft then take its shared side.
+template <typename Key, typename Value, typename Hash = FastHash,
+          template <typename> typename Alloc = DefaultAllocator,
+          typename LockPolicy = DefaultLockPolicy>
 class Map {
+  using BucketMutex = typename LockPolicy::BucketMutex;
+  using NodeMutex = typename LockPolicy::NodeMutex;
+  static constexpr bool kPerNodeLocks = LockPolicy::kPerNodeLocks;
+
   struct Bucket {
+    struct Node;
+    using NodePtr = std::unique_ptr<Node, AllocDeleter<Node, Alloc>>;
     struct Node {
       template <typename Val>
         requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
                      std::is_convertible_v<Val, Value>
-      Node(const Key& key, Val&& val) : key(key), val(std::forward<Val>(val)) {}
-      static void Swap(Node& n1, Node& n2) { std::swap(n1.val, n2.val); }
+      Node(uint64_t hash, const Key& key, Val&& val)
+          : hash(hash), key(key), val(std::forward<Val>(val)) {}
+      // Emplace path: key and value-constructor arguments are forwarded.
+      template <typename K, typename... Args>
+      Node(std::in_place_t, uint64_t hash, K&& key, Args&&... args)
+          : hash(hash),
+            key(std::forward<K>(key)),
+            val(std::forward<Args>(args)...) {}
 
+      // Full hash, cached so chain steps compare integers before keys and
+      // migration re-buckets without rehashing.
+      uint64_t hash;
       Key key;
       Value val;
-      mutable std::shared_mutex m;
-      std::unique_ptr<Node> next = nullptr;
+      // Value lock: readers copy val under the shared side, writers mutate
+      // it under the exclusive side. Never guards the chain links. An empty
+      // struct when the policy is bucket-only.
+      [[no_unique_address]] mutable NodeMutex m;
+      // Guarded by m; set by Erase before unlinking so ApplySoft can tell a
+      // node it reached lock-free is no longer current.
+      bool dead = false;
+      std::atomic<Node*> next = nullptr;
     };
 
-    // guards list head
-    mutable std::shared_mutex m;
-    std::unique_ptr<Node> head = nullptr;
+    // Serializes structural writers and migration; readers do not take it
+    // (except to wait out a migration after seeing moved, and for value
+    // access under a bucket-only policy).
+    mutable BucketMutex m;
+    std::atomic<Node*> head = nullptr;
+    // Set once this bucket's chain has been copied to the next table;
+    // operations that see it follow table->next instead.
+    std::atomic<bool> moved = false;
   };
   using Node = typename Bucket::Node;
+  using NodePtr = typename Bucket::NodePtr;
+
+  struct Table {
+    explicit Table(uint64_t size) : size(size), data(size) {}
+
+    uint64_t size;
+    std::vector<Bucket> data;
+    // Resize state; next is set once, when a migration begins.
+    std::atomic<Table*> next = nullptr;
+    std::atomic<uint64_t> migrate_pos = 0;
+    std::atomic<uint64_t> migrated = 0;
+  };
 
  public:
   explicit Map(uint64_t size = kDefaultSize);
-  ~Map() = default;
+  ~Map();
 
   Map(const Map& other) = delete;
   Map& operator=(const Map& other) = delete;
 
-  std::optional<Value> operator[](const Key& key);
-  std::optional<Value> Find(const Key& key);
-  [[nodiscard]] bool Contains(const Key& key) const;
+  std::optional<Value> operator[](const Key& key) { return FindImpl(key); }
+  std::optional<Value> Find(const Key& key) { return FindImpl(key); }
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return ContainsImpl(key);
+  }
+
+  // Heterogeneous lookups: available when Hash is transparent and hashes K
+  // directly (see HashableAs), e.g. a std::string_view probe against a
+  // Map<std::string, V, StringHash>. No temporary Key is built.
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  std::optional<Value> operator[](const K& key) { return FindImpl(key); }
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  std::optional<Value> Find(const K& key) { return FindImpl(key); }
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  [[nodiscard]] bool Contains(const K& key) const {
+    return ContainsImpl(key);
+  }
+
+  // Batched lookup: out[i] gets the result for keys[i] (out must be at
+  // least keys.size() long). Hashes a window of keys and prefetches their
+  // buckets before resolving any of them, so independent probes overlap
+  // their cache misses instead of stalling one by one.
+  void FindMany(std::span<const Key> keys,
+                std::span<std::optional<Value>> out) const;
 
   template <typename Val>
     requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
              std::is_convertible_v<Val, Value> bool
   Insert(const Key& key, Val&& value, bool replace = false);
-  bool Erase(const Key& key);
 
-  // Func(val) should be threadsafe.
+  // In-place insertion: key and the value-constructor arguments are
+  // forwarded, and the node is only allocated once the traversal has proven
+  // the key absent — a duplicate costs no allocation or copy. Returns false
+  // if the key already exists.
+  template <typename... Args>
+    requires std::is_constructible_v<Value, Args&&...>
+  bool Emplace(Key&& key, Args&&... args) {
+    return EmplaceImpl(std::move(key), std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+    requires std::is_constructible_v<Value, Args&&...>
+  bool Emplace(const Key& key, Args&&... args) {
+    return EmplaceImpl(key, std::forward<Args>(args)...);
+  }
+  // Heterogeneous probe: hashed and compared directly, a Key is built from
+  // it only on the insert path.
+  template <typename K, typename... Args>
+    requires HashableAs<K, Key, Hash> and std::is_constructible_v<Key, K&&> and
+             std::is_constructible_v<Value, Args&&...>
+  bool Emplace(K&& key, Args&&... args) {
+    return EmplaceImpl(std::forward<K>(key), std::forward<Args>(args)...);
+  }
+
+  // Batched insertion: moves the entries in, ordered by destination bucket
+  // so each bucket lock is taken once per batch instead of once per entry.
+  // With replace set, existing keys are overwritten (under the node lock,
+  // like Insert). Returns the number of new entries; entries are left
+  // moved-from. Feed it from a PipelineStage via MapSink (see pipeline.h).
+  uint64_t InsertBatch(std::span<std::pair<Key, Value>> entries,
+                       bool replace = false);
+
+  bool Erase(const Key& key) { return EraseImpl(key); }
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  bool Erase(const K& key) { return EraseImpl(key); }
+
+  // Func(val) runs under the node's SHARED lock (the bucket's, in
+  // bucket-only mode), so it should be threadsafe (atomics and the like);
+  // use ApplyHard for plain mutation.
+  template <typename Func>
+  bool ApplySoft(const Key& key, Func&& func) {
+    return ApplyImpl<false>(key, std::forward<Func>(func));
+  }
+  template <typename K, typename Func>
+    requires HashableAs<K, Key, Hash>
+  bool ApplySoft(const K& key, Func&& func) {
+    return ApplyImpl<false>(key, std::forward<Func>(func));
+  }
+
+  // Func(val) runs under the node's writer lock — exclusive against Find's
+  // copy-out and every other Apply on the entry — so the functor can
+  // mutate freely. Same memory we already pay for; no wrapper mutex
+  // needed. Returns false if the key is absent.
+  template <typename Func>
+  bool ApplyHard(const Key& key, Func&& func) {
+    return ApplyImpl<true>(key, std::forward<Func>(func));
+  }
+  template <typename K, typename Func>
+    requires HashableAs<K, Key, Hash>
+  bool ApplyHard(const K& key, Func&& func) {
+    return ApplyImpl<true>(key, std::forward<Func>(func));
+  }
+
+  // Counter-style upsert: ApplyHard an existing entry or insert
+  // default_val. Returns true on insert, like Upsert (of which this is the
+  // value-flavoured spelling).
+  template <typename Func, typename Val>
+    requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
+             std::is_convertible_v<Val, Value> bool
+  ApplyOrInsert(const Key& key, Func&& func, Val&& default_val) {
+    return Upsert(key, std::forward<Func>(func), std::forward<Val>(default_val));
+  }
+
+  // Single traversal for the cache-miss path: returns the mapped value,
+  // invoking factory() to create it only if the key is absent, while the
+  // insertion point is held.
+  template <typename Factory>
+  Value GetOrInsert(const Key& key, Factory&& factory);
+  // Applies func(val) to an existing entry (under that node's writer lock)
+  // or inserts insert_val if the key is absent. Returns true on insert.
+  template <typename Func, typename Val>
+    requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
+             std::is_convertible_v<Val, Value> bool
+  Upsert(const Key& key, Func&& func, Val&& insert_val);
+
+  // Visits every entry as func(key, val) under that node's shared lock.
+  // Weakly consistent: entries inserted, erased or migrated while the walk
+  // runs may be missed or visited twice. Quiesce writers for an exact pass.
   template <typename Func>
-  bool ApplySoft(const Key& key, Func&& func);
+  void ForEach(Func&& func) const;
+  // Same contract with the bucket array split across n_threads; func is
+  // called concurrently and should be threadsafe.
+  template <typename Func>
+  void ParallelForEach(Func&& func, uint64_t n_threads) const;
+
+  // Writes a binary snapshot of the contents (see snapshot.h); requires
+  // trivially copyable Key and Value. Weakly consistent like ForEach, so
+  // quiesce writers for an exact snapshot. Returns false on I/O failure.
+  bool Serialize(const std::string& path) const;
 
   [[nodiscard]] uint64_t Size() const;
 
+#ifdef THREADSAFE_STATS
+  struct Stats {
+    // chain_histogram[n] = buckets with chain length n; lengths >=
+    // kStatsMaxChain share the last slot.
+    std::vector<uint64_t> chain_histogram;
+    uint64_t max_chain = 0;
+    // Bucket-lock acquisitions that had to wait since construction.
+    uint64_t lock_waits = 0;
+  };
+  // Snapshot; chains are counted lock-free, so lengths are approximate
+  // under concurrent writes.
+  Stats GetStats() const;
+#endif
+
+  // Threadsafe: migrates one bucket at a time while lookups and writes keep
+  // serving; operations that land on a migrated bucket follow it to the new
+  // table. If a resize is already running, joins it instead of starting a
+  // second one. Returns once the new table is fully in place.
+  void Resize();
+  void Resize(uint64_t new_size);
+
   // Not threadsafe.
   Map(Map&& other) noexcept;
   Map& operator=(Map&& other) noexcept;
-  void Resize();
-  void Resize(uint64_t new_size);
   void FastInsert(Key&& key, Value&& value);
+  // Replaces the contents with a range of pair-likes (first/second),
+  // pre-sized for it. Hashes are computed in one parallel pass, then each
+  // thread owns a contiguous bucket range and links only the keys landing
+  // in it, so loading takes no locks at all.
+  template <typename It>
+  void BuildFrom(It first, It last,
+                 uint64_t n_threads = std::thread::hardware_concurrency());
+  // Replaces the contents with a snapshot written by Serialize. Returns
+  // false on I/O or format errors, leaving the contents untouched.
+  bool Deserialize(const std::string& path);
 
  private:
   static constexpr int kDefaultSize = 55001;
+  static constexpr uint64_t kMaxLoadFactor = 2;
+  static constexpr uint64_t kMigrateBatch = 8;
+  // Writes per thread between load-factor checks: summing the sharded
+  // counter touches every stripe other writers are dirtying, so the check
+  // must stay off the per-write path.
+  static constexpr uint64_t kGrowCheckEvery = 64;
+  // FindMany pipeline window; big enough to overlap misses, small enough
+  // to stay in the prefetchers' reach.
+  static constexpr uint64_t kProbeBatch = 32;
+#ifdef THREADSAFE_STATS
+  static constexpr uint64_t kStatsMaxChain = 16;
+#endif
+
+  // Bucket-lock entry points; compiled down to plain lock calls unless
+  // THREADSAFE_STATS is set, in which case contested acquisitions are
+  // counted.
+  std::shared_lock<BucketMutex> SharedLockBucket(const Bucket& bucket) const {
+#ifdef THREADSAFE_STATS
+    std::shared_lock lk(bucket.m, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      ++lock_waits_;
+      lk.lock();
+    }
+    return lk;
+#else
+    return std::shared_lock(bucket.m);
+#endif
+  }
+  std::unique_lock<BucketMutex> UniqueLockBucket(Bucket& bucket) {
+#ifdef THREADSAFE_STATS
+    std::unique_lock lk(bucket.m, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      ++lock_waits_;
+      lk.lock();
+    }
+    return lk;
+#else
+    return std::unique_lock(bucket.m);
+#endif
+  }
+  template <bool Exclusive>
+  auto LockBucket(Bucket& bucket) {
+    if constexpr (Exclusive) {
+      return UniqueLockBucket(bucket);
+    } else {
+      return SharedLockBucket(bucket);
+    }
+  }
+
+  // Holds on a node's value for the duration of the current scope; no-ops
+  // in bucket-only mode, where the caller's bucket lock already covers it.
+  static auto LockNodeShared(const Node& node) {
+    if constexpr (kPerNodeLocks) {
+      return std::shared_lock(node.m);
+    } else {
+      struct NoLock {};
+      return NoLock{};
+    }
+  }
+  static auto LockNodeUnique(const Node& node) {
+    if constexpr (kPerNodeLocks) {
+      return std::unique_lock(node.m);
+    } else {
+      struct NoLock {};
+      return NoLock{};
+    }
+  }
+
+  static void DeleteNode(void* ptr) {
+    Alloc<Node>::Delete(static_cast<Node*>(ptr));
+  }
+
+  // Shared walk bodies behind both the exact-Key and the heterogeneous
+  // overloads; K is anything Hash can hash that compares against Key.
+  template <typename K>
+  std::optional<Value> FindImpl(const K& key);
+  // Single probe with a precomputed hash; callers hold an epoch guard.
+  template <typename K>
+  std::optional<Value> FindHashed(Table* table, uint64_t h,
+                                  const K& key) const;
+  template <typename K>
+  bool ContainsImpl(const K& key) const;
+  template <typename K>
+  bool EraseImpl(const K& key);
+  // Shared walk for ApplySoft/ApplyHard: Exclusive picks which side of the
+  // value lock func runs under (the node's, or the bucket's in bucket-only
+  // mode).
+  template <bool Exclusive, typename K, typename Func>
+  bool ApplyImpl(const K& key, Func&& func);
+  template <typename K, typename... Args>
+  bool EmplaceImpl(K&& key, Args&&... args);
+
+  // Visits buckets [lo, hi) of one table; shared by ForEach and
+  // ParallelForEach. The caller holds an epoch guard.
+  template <typename Func>
+  void ForEachBucketRange(const Table& table, uint64_t lo, uint64_t hi,
+                          Func& func) const;
 
-  uint64_t size_;
-  std::atomic<uint64_t> count_ = 0;
-  std::vector<Bucket> data_;
+  // Copies one bucket's chain into next under the bucket's writer lock. The
+  // old chain is left intact as a frozen snapshot for readers already
+  // walking it and retired through the epoch system.
+  void MigrateBucket(Bucket& bucket, Table& next);
+  // Claims and migrates up to max_buckets pending buckets of table's
+  // in-progress resize (if any); whoever finishes the last bucket publishes
+  // the new table.
+  void HelpMigrate(Table* table, uint64_t max_buckets);
+  // Starts a doubling once the average chain length passes kMaxLoadFactor,
+  // and chips in a few buckets whenever a migration is pending, so growth is
+  // amortized across writers instead of stalling one of them.
+  void MaybeGrow(Table* table);
+  // Deletes every chain still owned by the table list; migrated and erased
+  // nodes already belong to the epoch system and are skipped.
+  void DeleteChains();
+  // Single-threaded chain append shared by FastInsert and BuildFrom.
+  void UnlockedInsert(Table& table, uint64_t h, Key&& key, Value&& val);
+
+  // Operations hold raw Table pointers without pinning them, so every table
+  // this container ever created stays owned here until destruction; retired
+  // tables have already handed their nodes over and keep only the empty
+  // bucket array.
+  std::atomic<Table*> table_;
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::mutex tables_m_;
+  ShardedCounter count_;
   Hash hash_;
+#ifdef THREADSAFE_STATS
+  mutable ShardedCounter lock_waits_;
+#endif
 };
 
-template <typename Key, typename Value, typename Hash>
-Map<Key, Value, Hash>::Map(uint64_t size) : size_(size), data_(size_) {}
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Map<Key, Value, Hash, Alloc, LockPolicy>::Map(uint64_t size)
+    : table_(nullptr) {
+  tables_.push_back(std::make_unique<Table>(size));
+  table_.store(tables_.back().get());
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Map<Key, Value, Hash, Alloc, LockPolicy>::~Map() {
+  DeleteChains();
+}
 
-template <typename Key, typename Value, typename Hash>
-std::optional<Value> Map<Key, Value, Hash>::operator[](const Key& key) {
-  uint64_t h = hash_(key) % size_;
-  auto& bucket = data_[h];
-  std::shared_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+std::optional<Value> Map<Key, Value, Hash, Alloc, LockPolicy>::FindImpl(const K& key) {
+  const uint64_t h = hash_(key);
+  auto guard = Epoch::Pin();
+  return FindHashed(table_.load(), h, key);
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+std::optional<Value> Map<Key, Value, Hash, Alloc, LockPolicy>::FindHashed(
+    Table* table, uint64_t h, const K& key) const {
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    if constexpr (kPerNodeLocks) {
+      if (bucket.moved.load()) {
+        // The copy runs under the bucket lock; taking it shared waits the
+        // migration out, so the new table is complete when we get there.
+        SharedLockBucket(bucket);
+        table = table->next.load();
+        continue;
+      }
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        if (n->hash == h && n->key == key) {
+          std::shared_lock n_lk(n->m);
+          return std::optional{n->val};
+        }
+      }
+    } else {
+      // Bucket-only mode: the value copy needs the bucket's shared lock,
+      // whose acquisition doubles as the wait on a migration in progress.
+      auto lk = SharedLockBucket(bucket);
+      if (bucket.moved.load()) {
+        lk.unlock();
+        table = table->next.load();
+        continue;
+      }
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        if (n->hash == h && n->key == key) {
+          return std::optional{n->val};
+        }
+      }
+    }
     return std::nullopt;
   }
+}
 
-  Node* n = bucket.head.get();
-  if (n->key == key) {
-    std::optional out{n->val};
-    return out;
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::FindMany(
+    std::span<const Key> keys, std::span<std::optional<Value>> out) const {
+  auto guard = Epoch::Pin();
+  uint64_t hashes[kProbeBatch];
+  for (uint64_t base = 0; base < keys.size(); base += kProbeBatch) {
+    const uint64_t n = std::min(kProbeBatch, keys.size() - base);
+    Table* table = table_.load();
+    for (uint64_t i = 0; i < n; ++i) {
+      hashes[i] = hash_(keys[base + i]);
+      __builtin_prefetch(&table->data[FastRange(hashes[i], table->size)]);
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      out[base + i] = FindHashed(table, hashes[i], keys[base + i]);
+    }
   }
-  Node* next = nullptr;
-  while ((next = n->next.get()) != nullptr) {
-    std::shared_lock n_lk(next->m);
-    lk.unlock();
-    if (next->key == key) {
-      std::optional out{next->val};
-      return out;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+bool Map<Key, Value, Hash, Alloc, LockPolicy>::ContainsImpl(const K& key) const {
+  const uint64_t h = hash_(key);
+  auto guard = Epoch::Pin();
+  Table* table = table_.load();
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    if (bucket.moved.load()) {
+      SharedLockBucket(bucket);
+      table = table->next.load();
+      continue;
+    }
+    for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+      if (n->hash == h && n->key == key) {
+        return true;
+      }
     }
-    n = next;
-    lk = std::move(n_lk);
+    return false;
   }
-  return std::nullopt;
 }
 
-template <typename Key, typename Value, typename Hash>
-std::optional<Value> Map<Key, Value, Hash>::Find(const Key& key) {
-  auto out = this->operator[](key);
-  return out;
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Val>
+  requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
+           std::is_convertible_v<Val, Value> bool
+Map<Key, Value, Hash, Alloc, LockPolicy>::Insert(const Key& key, Val&& val, bool replace) {
+  const uint64_t h = hash_(key);
+  Table* table = table_.load();
+  MaybeGrow(table);
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved.load()) {
+      lk.unlock();
+      table = table->next.load();
+      continue;
+    }
+    Node* prev = nullptr;
+    for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+      if (n->hash == h && n->key == key) {
+        if (!replace) {
+          return false;
+        }
+        // Readers copy val under the shared side of the value lock.
+        [[maybe_unused]] auto n_lk = LockNodeUnique(*n);
+        n->val = std::forward<Val>(val);
+        return true;
+      }
+      prev = n;
+    }
+    // Key proven absent: only now pay for the node.
+    Node* node = Alloc<Node>::New(h, key, std::forward<Val>(val));
+    if (prev == nullptr) {
+      bucket.head.store(node);
+    } else {
+      prev->next.store(node);
+    }
+    ++count_;
+    return true;
+  }
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K, typename... Args>
+bool Map<Key, Value, Hash, Alloc, LockPolicy>::EmplaceImpl(K&& key, Args&&... args) {
+  const uint64_t h = hash_(key);
+  Table* table = table_.load();
+  MaybeGrow(table);
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved.load()) {
+      lk.unlock();
+      table = table->next.load();
+      continue;
+    }
+    Node* prev = nullptr;
+    for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+      if (n->hash == h && n->key == key) {
+        return false;
+      }
+      prev = n;
+    }
+    Node* node = Alloc<Node>::New(std::in_place, h, std::forward<K>(key),
+                                  std::forward<Args>(args)...);
+    if (prev == nullptr) {
+      bucket.head.store(node);
+    } else {
+      prev->next.store(node);
+    }
+    ++count_;
+    return true;
+  }
 }
 
-template <typename Key, typename Value, typename Hash>
-bool Map<Key, Value, Hash>::Contains(const Key& key) const {
-  uint64_t h = hash_(key) % size_;
-  auto& bucket = data_[h];
-  std::shared_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+uint64_t Map<Key, Value, Hash, Alloc, LockPolicy>::InsertBatch(
+    std::span<std::pair<Key, Value>> entries, bool replace) {
+  if (entries.empty()) {
+    return 0;
+  }
+  Table* table = table_.load();
+  MaybeGrow(table);
+  // Hash once, then order by destination bucket; entries sharing a bucket
+  // form a run handled under one lock acquisition.
+  std::vector<uint64_t> hashes(entries.size());
+  std::vector<std::pair<uint64_t, uint64_t>> order(entries.size());
+  for (uint64_t i = 0; i < entries.size(); ++i) {
+    hashes[i] = hash_(entries[i].first);
+    order[i] = {FastRange(hashes[i], table->size), i};
+  }
+  std::sort(order.begin(), order.end());
+  uint64_t inserted = 0;
+  for (uint64_t i = 0; i < order.size();) {
+    uint64_t run_end = i;
+    while (run_end < order.size() && order[run_end].first == order[i].first) {
+      ++run_end;
+    }
+    auto& bucket = table->data[order[i].first];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved.load()) {
+      lk.unlock();
+      // A migration raced the batch; the per-entry paths follow the table
+      // list. Rare, so the rehash they cost does not matter.
+      for (; i < run_end; ++i) {
+        auto& [key, val] = entries[order[i].second];
+        if (replace) {
+          inserted += Upsert(
+              key, [&val](Value& v) { v = std::move(val); }, std::move(val));
+        } else {
+          inserted += Emplace(std::move(key), std::move(val));
+        }
+      }
+      continue;
+    }
+    for (; i < run_end; ++i) {
+      const uint64_t h = hashes[order[i].second];
+      auto& [key, val] = entries[order[i].second];
+      Node* prev = nullptr;
+      Node* found = nullptr;
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        if (n->hash == h && n->key == key) {
+          found = n;
+          break;
+        }
+        prev = n;
+      }
+      if (found != nullptr) {
+        if (replace) {
+          [[maybe_unused]] auto n_lk = LockNodeUnique(*found);
+          found->val = std::move(val);
+        }
+        continue;
+      }
+      Node* node =
+          Alloc<Node>::New(std::in_place, h, std::move(key), std::move(val));
+      if (prev == nullptr) {
+        bucket.head.store(node);
+      } else {
+        prev->next.store(node);
+      }
+      ++count_;
+      ++inserted;
+    }
+  }
+  return inserted;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+bool Map<Key, Value, Hash, Alloc, LockPolicy>::EraseImpl(const K& key) {
+  const uint64_t h = hash_(key);
+  Table* table = table_.load();
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved.load()) {
+      lk.unlock();
+      table = table->next.load();
+      continue;
+    }
+    Node* prev = nullptr;
+    for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+      if (n->hash == h && n->key == key) {
+        {
+          // ApplySoft rechecks dead under the node lock before mutating, so
+          // nothing lands on the node once we unlink it.
+          [[maybe_unused]] auto n_lk = LockNodeUnique(*n);
+          n->dead = true;
+        }
+        Node* after = n->next.load();
+        if (prev == nullptr) {
+          bucket.head.store(after);
+        } else {
+          prev->next.store(after);
+        }
+        --count_;
+        // Readers may still be walking through the node; the epoch system
+        // frees it once they are done.
+        Epoch::Retire(n, &DeleteNode);
+        return true;
+      }
+      prev = n;
+    }
     return false;
   }
-  Node* n = bucket.head.get();
-  if (n->key == key) {
-    return true;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <bool Exclusive, typename K, typename Func>
+bool Map<Key, Value, Hash, Alloc, LockPolicy>::ApplyImpl(const K& key, Func&& func) {
+  const uint64_t h = hash_(key);
+  auto guard = Epoch::Pin();
+  Table* table = table_.load();
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    if constexpr (kPerNodeLocks) {
+      using Lock = std::conditional_t<Exclusive, std::unique_lock<NodeMutex>,
+                                      std::shared_lock<NodeMutex>>;
+      if (bucket.moved.load()) {
+        SharedLockBucket(bucket);
+        table = table->next.load();
+        continue;
+      }
+      bool restart = false;
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        if (n->hash != h || !(n->key == key)) {
+          continue;
+        }
+        Lock n_lk(n->m);
+        // The mutation must land on the current node: an erase or a
+        // migration that got in between retired this one, so rewalk. Erase
+        // marks dead and migration sets moved before they take the node
+        // lock, so seeing neither here means the mutation is picked up.
+        if (n->dead || bucket.moved.load()) {
+          restart = true;
+          break;
+        }
+        std::forward<Func>(func)(n->val);
+        return true;
+      }
+      if (restart) {
+        table = table_.load();
+        continue;
+      }
+    } else {
+      // Bucket-only mode: the bucket lock excludes erase and migration for
+      // the whole walk, so no dead recheck is needed.
+      auto lk = LockBucket<Exclusive>(bucket);
+      if (bucket.moved.load()) {
+        lk.unlock();
+        table = table->next.load();
+        continue;
+      }
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        if (n->hash == h && n->key == key) {
+          std::forward<Func>(func)(n->val);
+          return true;
+        }
+      }
+    }
+    return false;
   }
-  Node* next = nullptr;
-  while ((next = n->next.get()) != nullptr) {
-    std::shared_lock n_lk(next->m);
-    lk.unlock();
-    if (next->key == key) {
-      return true;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Factory>
+Value Map<Key, Value, Hash, Alloc, LockPolicy>::GetOrInsert(const Key& key,
+                                                Factory&& factory) {
+  const uint64_t h = hash_(key);
+  Table* table = table_.load();
+  MaybeGrow(table);
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved.load()) {
+      lk.unlock();
+      table = table->next.load();
+      continue;
+    }
+    Node* prev = nullptr;
+    for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+      if (n->hash == h && n->key == key) {
+        [[maybe_unused]] auto n_lk = LockNodeShared(*n);
+        return n->val;
+      }
+      prev = n;
+    }
+    Node* node = Alloc<Node>::New(h, key, factory());
+    if (prev == nullptr) {
+      bucket.head.store(node);
+    } else {
+      prev->next.store(node);
     }
-    n = next;
-    lk = std::move(n_lk);
+    ++count_;
+    // Published: concurrent ApplySoft may already be mutating the value, so
+    // copy it out under the node lock like any other reader.
+    [[maybe_unused]] auto n_lk = LockNodeShared(*node);
+    return node->val;
   }
-  return false;
 }
 
-template <typename Key, typename Value, typename Hash>
-template <typename Val>
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func, typename Val>
   requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
            std::is_convertible_v<Val, Value> bool
-Map<Key, Value, Hash>::Insert(const Key& key, Val&& val, bool replace) {
-  std::unique_ptr<Node> new_node =
-      std::make_unique<Node>(key, std::forward<Val>(val));
-  uint64_t h = hash_(key) % size_;
-  auto& bucket = data_[h];
-  std::unique_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
-    bucket.head = std::move(new_node);
+Map<Key, Value, Hash, Alloc, LockPolicy>::Upsert(const Key& key, Func&& func,
+                                     Val&& insert_val) {
+  const uint64_t h = hash_(key);
+  Table* table = table_.load();
+  MaybeGrow(table);
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved.load()) {
+      lk.unlock();
+      table = table->next.load();
+      continue;
+    }
+    Node* prev = nullptr;
+    for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+      if (n->hash == h && n->key == key) {
+        [[maybe_unused]] auto n_lk = LockNodeUnique(*n);
+        std::forward<Func>(func)(n->val);
+        return false;
+      }
+      prev = n;
+    }
+    Node* node = Alloc<Node>::New(h, key, std::forward<Val>(insert_val));
+    if (prev == nullptr) {
+      bucket.head.store(node);
+    } else {
+      prev->next.store(node);
+    }
     ++count_;
     return true;
   }
-  Node* n = bucket.head.get();
-  if (n->key == key) {
-    if (!replace) {
-      return false;
-    }
-    Node::Swap(*new_node, *n);
-    return true;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::ForEach(Func&& func) const {
+  auto guard = Epoch::Pin();
+  // During a migration entries are spread over the table list; moved
+  // buckets are waited out so their nodes are in place before the walk
+  // reaches the next table.
+  for (Table* table = table_.load(); table != nullptr;
+       table = table->next.load()) {
+    ForEachBucketRange(*table, 0, table->size, func);
   }
-  Node* next = nullptr;
-  while ((next = n->next.get()) != nullptr) {
-    std::unique_lock n_lk(next->m);
-    lk.unlock();
-    if (next->key == key) {
-      if (!replace) {
-        return false;
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::ParallelForEach(Func&& func,
+                                                   uint64_t n_threads) const {
+  if (n_threads <= 1) {
+    ForEach(std::forward<Func>(func));
+    return;
+  }
+  std::vector<std::thread> workers;
+  workers.reserve(n_threads);
+  for (uint64_t t = 0; t < n_threads; ++t) {
+    workers.emplace_back([this, &func, n_threads, t]() {
+      auto guard = Epoch::Pin();
+      for (Table* table = table_.load(); table != nullptr;
+           table = table->next.load()) {
+        ForEachBucketRange(*table, t * table->size / n_threads,
+                           (t + 1) * table->size / n_threads, func);
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::ForEachBucketRange(const Table& table,
+                                                      uint64_t lo, uint64_t hi,
+                                                      Func& func) const {
+  for (uint64_t i = lo; i < hi; ++i) {
+    const Bucket& bucket = table.data[i];
+    if constexpr (kPerNodeLocks) {
+      if (bucket.moved.load()) {
+        // Wait out the copy so the chain is complete in the next table.
+        SharedLockBucket(bucket);
+        continue;
+      }
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        std::shared_lock n_lk(n->m);
+        func(n->key, n->val);
+      }
+    } else {
+      auto lk = SharedLockBucket(bucket);
+      if (bucket.moved.load()) {
+        continue;  // waited out by the acquisition above
+      }
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        func(n->key, n->val);
       }
-      Node::Swap(*new_node, *next);
-      return true;
     }
-    n = next;
-    lk = std::move(n_lk);
   }
-  n->next = std::move(new_node);
-  ++count_;
-  return true;
 }
 
-template <typename Key, typename Value, typename Hash>
-bool Map<Key, Value, Hash>::Erase(const Key& key) {
-  auto h = hash_(key) % size_;
-  auto& bucket = data_[h];
-  std::unique_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+bool Map<Key, Value, Hash, Alloc, LockPolicy>::Serialize(const std::string& path) const {
+  static_assert(std::is_trivially_copyable_v<Key> and
+                    std::is_trivially_copyable_v<Value>,
+                "snapshots need trivially copyable keys and values");
+  using Entry = SnapshotMapEntry<Key, Value>;
+  // Group by destination bucket first so the file can carry a per-bucket
+  // offset index for the mapped view.
+  const uint64_t buckets = table_.load()->size;
+  std::vector<std::vector<Entry>> groups(buckets);
+  uint64_t total = 0;
+  {
+    auto guard = Epoch::Pin();
+    for (Table* table = table_.load(); table != nullptr;
+         table = table->next.load()) {
+      for (const Bucket& bucket : table->data) {
+        if constexpr (kPerNodeLocks) {
+          if (bucket.moved.load()) {
+            SharedLockBucket(bucket);
+            continue;
+          }
+          for (Node* n = bucket.head.load(); n != nullptr;
+               n = n->next.load()) {
+            std::shared_lock n_lk(n->m);
+            groups[FastRange(n->hash, buckets)].push_back(
+                {n->hash, n->key, n->val});
+            ++total;
+          }
+        } else {
+          auto lk = SharedLockBucket(bucket);
+          if (bucket.moved.load()) {
+            continue;
+          }
+          for (Node* n = bucket.head.load(); n != nullptr;
+               n = n->next.load()) {
+            groups[FastRange(n->hash, buckets)].push_back(
+                {n->hash, n->key, n->val});
+            ++total;
+          }
+        }
+      }
+    }
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
     return false;
   }
-  Node* node = bucket.head.get();
-  if (node->key == key) {
-    bucket.head = std::move(node->next);
-    --count_;
-    return true;
+  SnapshotHeader header{kSnapshotMagic, kSnapshotVersion, buckets, total};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t off = 0;
+  for (const auto& group : groups) {
+    out.write(reinterpret_cast<const char*>(&off), sizeof(off));
+    off += group.size();
   }
-  Node* next = nullptr;
-  while ((next = node->next.get()) != nullptr) {
-    std::unique_lock n_lk(next->m);
-    if (next->key == key) {
-      node->next = std::move(next->next);
-      --count_;
-      return true;
-    }
-    lk.unlock();
-    node = next;
-    lk = std::move(n_lk);
+  out.write(reinterpret_cast<const char*>(&off), sizeof(off));
+  const std::string pad(
+      SnapshotDataOffset(buckets, alignof(Entry)) -
+          (sizeof(header) + (buckets + 1) * sizeof(uint64_t)),
+      '\0');
+  out.write(pad.data(), pad.size());
+  for (const auto& group : groups) {
+    out.write(reinterpret_cast<const char*>(group.data()),
+              group.size() * sizeof(Entry));
   }
-  return false;
+  return static_cast<bool>(out);
 }
 
-template <typename Key, typename Value, typename Hash>
-template <typename Func>
-bool Map<Key, Value, Hash>::ApplySoft(const Key& key, Func&& func) {
-  auto h = hash_(key) % size_;
-  auto& bucket = data_[h];
-  std::shared_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+bool Map<Key, Value, Hash, Alloc, LockPolicy>::Deserialize(const std::string& path) {
+  static_assert(std::is_trivially_copyable_v<Key> and
+                    std::is_trivially_copyable_v<Value>,
+                "snapshots need trivially copyable keys and values");
+  using Entry = SnapshotMapEntry<Key, Value>;
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
     return false;
   }
-  Node* node = bucket.head.get();
-  if (node->key == key) {
-    std::forward<Func>(func)(node->val);
-    return true;
+  SnapshotHeader header{};
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || header.magic != kSnapshotMagic ||
+      header.version != kSnapshotVersion || header.buckets == 0) {
+    return false;
+  }
+  // The header drives the allocations below, so bound its counts by the
+  // file's actual size first — a truncated or corrupt snapshot must fail
+  // cleanly, not throw from the allocator. MappedSnapshot::Open runs the
+  // same check against the mapped length.
+  in.seekg(0, std::ios::end);
+  const auto file_size = static_cast<uint64_t>(in.tellg());
+  if (header.buckets > (file_size - sizeof(SnapshotHeader)) / sizeof(uint64_t)) {
+    return false;
   }
-  Node* next = nullptr;
-  while ((next = node->next.get()) != nullptr) {
-    std::shared_lock n_lk(next->m);
-    lk.unlock();
-    if (next->key == key) {
-      std::forward<Func>(func)(node->val);
-      return true;
+  const uint64_t data_off = SnapshotDataOffset(header.buckets, alignof(Entry));
+  if (data_off > file_size ||
+      header.entries > (file_size - data_off) / sizeof(Entry)) {
+    return false;
+  }
+  in.seekg(data_off);
+  std::vector<Entry> entries(header.entries);
+  in.read(reinterpret_cast<char*>(entries.data()),
+          entries.size() * sizeof(Entry));
+  if (!in) {
+    return false;
+  }
+  DeleteChains();
+  tables_.clear();
+  tables_.push_back(std::make_unique<Table>(header.buckets));
+  table_.store(tables_.back().get());
+  count_ = ShardedCounter();
+  Table& table = *tables_.back();
+  for (const Entry& entry : entries) {
+    // The stored hash is reused directly; see the format note in snapshot.h.
+    UnlockedInsert(table, entry.hash, Key(entry.key), Value(entry.val));
+  }
+  return true;
+}
+
+#ifdef THREADSAFE_STATS
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+typename Map<Key, Value, Hash, Alloc, LockPolicy>::Stats
+Map<Key, Value, Hash, Alloc, LockPolicy>::GetStats() const {
+  Stats stats;
+  stats.chain_histogram.assign(kStatsMaxChain + 1, 0);
+  stats.lock_waits = lock_waits_.Get();
+  auto guard = Epoch::Pin();
+  // During a migration live chains are spread over the table list; every
+  // node sits in exactly one bucket that is not yet moved.
+  for (Table* table = table_.load(); table != nullptr;
+       table = table->next.load()) {
+    for (const Bucket& bucket : table->data) {
+      if (bucket.moved.load()) {
+        continue;
+      }
+      uint64_t len = 0;
+      for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+        ++len;
+      }
+      stats.max_chain = std::max(stats.max_chain, len);
+      ++stats.chain_histogram[std::min(len, kStatsMaxChain)];
     }
-    node = next;
-    lk = std::move(n_lk);
   }
-  return false;
+  return stats;
 }
+#endif
 
-template <typename Key, typename Value, typename Hash>
-uint64_t Map<Key, Value, Hash>::Size() const {
-  return count_;
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+uint64_t Map<Key, Value, Hash, Alloc, LockPolicy>::Size() const {
+  return count_.Get();
 }
 
-template <typename Key, typename Value, typename Hash>
-Map<Key, Value, Hash>::Map(Map&& other) noexcept
-    : size_(other.size_), count_(other.count_), data_(std::move(other.data_)) {
-  other.size_ = 0;
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Map<Key, Value, Hash, Alloc, LockPolicy>::Map(Map&& other) noexcept
+    : table_(other.table_.load()),
+      tables_(std::move(other.tables_)),
+      count_(std::move(other.count_)) {
+  other.table_.store(nullptr);
 }
 
-template <typename Key, typename Value, typename Hash>
-Map<Key, Value, Hash>& Map<Key, Value, Hash>::operator=(Map&& other) noexcept {
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Map<Key, Value, Hash, Alloc, LockPolicy>& Map<Key, Value, Hash, Alloc, LockPolicy>::operator=(
+    Map&& other) noexcept {
   if (this == &other) {
     return *this;
   }
-  size_ = other.size_;
-  count_ = other.count_;
-  data_ = std::move(other.data_);
-  other.size_ = 0;
+  DeleteChains();
+  table_.store(other.table_.load());
+  tables_ = std::move(other.tables_);
+  count_ = std::move(other.count_);
+  other.table_.store(nullptr);
   return *this;
 }
 
-template <typename Key, typename Value, typename Hash>
-void Map<Key, Value, Hash>::Resize() {
-  Resize(size_ * 2);
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::Resize() {
+  Resize(table_.load()->size * 2);
 }
 
-template <typename Key, typename Value, typename Hash>
-void Map<Key, Value, Hash>::Resize(uint64_t new_size) {
-  if (new_size == 0) {
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::Resize(uint64_t new_size) {
+  Table* table = table_.load();
+  if (new_size == 0 || new_size == table->size) {
     return;
   }
-  Map<Key, Value, Hash> new_map(new_size);
-  std::for_each(data_.begin(), data_.end(), [&new_map](auto&& bucket) {
-    for (Node* node = bucket.head.get(); node != nullptr;
-         node = node->next.get()) {
-      new_map.FastInsert(std::move(node->key), std::move(node->val));
+  {
+    std::scoped_lock lk(tables_m_);
+    // If a resize is already running, help it finish instead of starting a
+    // second one.
+    if (table->next.load() == nullptr) {
+      tables_.push_back(std::make_unique<Table>(new_size));
+      table->next.store(tables_.back().get());
     }
-  });
-  *this = std::move(new_map);
+  }
+  HelpMigrate(table, table->size);
+  while (table_.load() == table) {
+    std::this_thread::yield();
+  }
 }
 
-template <typename Key, typename Value, typename Hash>
-void Map<Key, Value, Hash>::FastInsert(Key&& key, Value&& val) {
-  auto h = hash_(key) % size_;
-  if (data_[h].head == nullptr) {
-    data_[h].head = std::make_unique<Node>(std::move(key), std::move(val));
-    ++count_;
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::MigrateBucket(Bucket& bucket, Table& next) {
+  std::unique_lock lk(bucket.m);
+  // Redirect first: writers queue on the bucket lock we hold, and readers
+  // that see the flag reacquire it shared before following the redirect, so
+  // nobody reaches the new table until the copy below is complete. Readers
+  // already past the flag keep walking the old chain, which stays intact.
+  bucket.moved.store(true);
+  for (Node* node = bucket.head.load(); node != nullptr;) {
+    Node* after = node->next.load();
+    {
+      // Waits out ApplySoft, which rechecks moved under the node lock:
+      // mutations applied before this point are copied, later ones
+      // redirect. In bucket-only mode the bucket lock we hold already
+      // excludes every value access, so there is nothing to wait out.
+      [[maybe_unused]] auto n_lk = LockNodeUnique(*node);
+      auto& dst = next.data[FastRange(node->hash, next.size)];
+      std::unique_lock d_lk(dst.m);
+      Node* copy = Alloc<Node>::New(node->hash, node->key, node->val);
+      copy->next.store(dst.head.load());
+      dst.head.store(copy);
+    }
+    Epoch::Retire(node, &DeleteNode);
+    node = after;
+  }
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::HelpMigrate(Table* table, uint64_t max_buckets) {
+  Table* next = table->next.load();
+  if (next == nullptr) {
     return;
   }
-  Node* prev = data_[h].head.get();
-  if (prev->key == key) {
-    prev->val = std::move(val);
+  for (uint64_t done = 0; done < max_buckets; ++done) {
+    uint64_t i = table->migrate_pos.fetch_add(1);
+    if (i >= table->size) {
+      return;
+    }
+    MigrateBucket(table->data[i], *next);
+    if (table->migrated.fetch_add(1) + 1 == table->size) {
+      table_.store(next);
+    }
+  }
+}
+
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::MaybeGrow(Table* table) {
+  if (table->next.load() == nullptr) {
+    // The countdown is thread-local and shared across instances, which only
+    // paces the check; the worst overshoot (threads * kGrowCheckEvery
+    // writes past the limit) is noise next to size * kMaxLoadFactor.
+    static thread_local uint64_t writes = 0;
+    if (++writes % kGrowCheckEvery != 0) {
+      return;
+    }
+    if (count_.Get() <= table->size * kMaxLoadFactor) {
+      return;
+    }
+    std::scoped_lock lk(tables_m_);
+    if (table->next.load() == nullptr) {
+      tables_.push_back(std::make_unique<Table>(table->size * 2));
+      table->next.store(tables_.back().get());
+    }
+  }
+  HelpMigrate(table, kMigrateBatch);
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::DeleteChains() {
+  for (auto& table : tables_) {
+    for (auto& bucket : table->data) {
+      if (bucket.moved.load()) {
+        continue;
+      }
+      Node* n = bucket.head.load();
+      while (n != nullptr) {
+        Node* next = n->next.load();
+        Alloc<Node>::Delete(n);
+        n = next;
+      }
+      bucket.head.store(nullptr);
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::FastInsert(Key&& key, Value&& val) {
+  const uint64_t h = hash_(key);
+  UnlockedInsert(*table_.load(), h, std::move(key), std::move(val));
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename It>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::BuildFrom(It first, It last,
+                                             uint64_t n_threads) {
+  const uint64_t n = std::distance(first, last);
+  DeleteChains();
+  tables_.clear();
+  tables_.push_back(std::make_unique<Table>(n / kMaxLoadFactor + 1));
+  table_.store(tables_.back().get());
+  count_ = ShardedCounter();
+  if (n == 0) {
     return;
   }
-  for (Node* next = prev->next; next != nullptr;
-       prev = next, next = next->next) {
-    if (next->key == key) {
-      next->val = std::move(val);
+  Table& table = *tables_.back();
+  if (n_threads == 0) {
+    n_threads = 1;
+  }
+  if (n_threads > table.size) {
+    n_threads = table.size;
+  }
+  if (n_threads == 1) {
+    for (It it = first; it != last; ++it) {
+      Key key = it->first;
+      UnlockedInsert(table, hash_(key), std::move(key), Value(it->second));
+    }
+    return;
+  }
+  // One hashing pass over element slices, so the bucket-partitioned fill
+  // below only compares integers for the keys it does not own.
+  std::vector<uint64_t> hashes(n);
+  {
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads);
+    for (uint64_t t = 0; t < n_threads; ++t) {
+      workers.emplace_back([this, first, n, n_threads, t, &hashes]() {
+        uint64_t lo = t * n / n_threads;
+        uint64_t hi = (t + 1) * n / n_threads;
+        It it = first;
+        std::advance(it, lo);
+        for (uint64_t i = lo; i < hi; ++i, ++it) {
+          hashes[i] = hash_(it->first);
+        }
+      });
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+  }
+  {
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads);
+    for (uint64_t t = 0; t < n_threads; ++t) {
+      workers.emplace_back([this, first, last, n_threads, t, &hashes,
+                            &table]() {
+        uint64_t lo = t * table.size / n_threads;
+        uint64_t hi = (t + 1) * table.size / n_threads;
+        uint64_t i = 0;
+        for (It it = first; it != last; ++it, ++i) {
+          uint64_t b = FastRange(hashes[i], table.size);
+          if (b < lo || b >= hi) {
+            continue;
+          }
+          Key key = it->first;
+          UnlockedInsert(table, hashes[i], std::move(key), Value(it->second));
+        }
+      });
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+  }
+}
+
+template <typename Key, typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Map<Key, Value, Hash, Alloc, LockPolicy>::UnlockedInsert(Table& table, uint64_t h,
+                                                  Key&& key, Value&& val) {
+  auto& bucket = table.data[FastRange(h, table.size)];
+  Node* prev = nullptr;
+  for (Node* n = bucket.head.load(); n != nullptr; n = n->next.load()) {
+    if (n->hash == h && n->key == key) {
+      n->val = std::move(val);
       return;
     }
+    prev = n;
+  }
+  Node* node = Alloc<Node>::New(h, std::move(key), std::move(val));
+  if (prev == nullptr) {
+    bucket.head.store(node);
+  } else {
+    prev->next.store(node);
   }
-  prev->next = std::make_unique<Node>(std::move(key), std::move(val));
   ++count_;
 }
 
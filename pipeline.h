@@ -0,0 +1,114 @@
+#ifndef THREADSAFE__PIPELINE_H_
+#define THREADSAFE__PIPELINE_H_
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "lock_policy.h"
+#include "map.h"
+#include "pool_allocator.h"
+#include "queue.h"
+
+// One stage of the standard service topology: producer threads Push parsed
+// records in, a pool of workers pops them in batches and hands each batch
+// to a sink functor. Close (or destruction) stops intake, drains what is
+// already queued and joins the workers, so shutdown needs no hand-rolled
+// flags. Pair it with MapSink below to land batches in a shared Map.
+template <typename In, template <typename> typename Alloc = DefaultAllocator>
+class PipelineStage {
+ public:
+  static constexpr uint64_t kDefaultBatch = 64;
+
+  // Spawns n_workers threads running sink(batch); every worker invokes the
+  // same sink concurrently, so it must be threadsafe. Batches hold up to
+  // max_batch records: the first pop blocks, the rest is whatever is
+  // already queued, so a trickling producer still gets per-record latency.
+  PipelineStage(uint64_t n_workers, std::function<void(std::span<In>)> sink,
+                uint64_t max_batch = kDefaultBatch)
+      : sink_(std::move(sink)), max_batch_(max_batch == 0 ? 1 : max_batch) {
+    workers_.reserve(n_workers);
+    for (uint64_t t = 0; t < n_workers; ++t) {
+      workers_.emplace_back([this]() { Worker(); });
+    }
+  }
+  ~PipelineStage() { Close(); }
+
+  PipelineStage(const PipelineStage& other) = delete;
+  PipelineStage& operator=(const PipelineStage& other) = delete;
+
+  void Push(In val) { queue_.Push(std::move(val)); }
+  template <typename It>
+  void PushBatch(It first, It last) {
+    queue_.PushBatch(first, last);
+  }
+  // Records pushed but not yet handed to the sink; relaxed like
+  // Queue::Length.
+  [[nodiscard]] uint64_t Pending() const { return queue_.Length(); }
+
+  // Stops intake (later pushes are dropped, per Queue::Close), lets the
+  // workers drain everything already queued and joins them. Idempotent;
+  // returns once the last batch has been sunk.
+  void Close() {
+    queue_.Close();
+    for (auto& w : workers_) {
+      if (w.joinable()) {
+        w.join();
+      }
+    }
+  }
+
+ private:
+  void Worker() {
+    std::vector<In> batch;
+    for (;;) {
+      // WaitAndPop returns nullopt only once the queue is closed and
+      // drained, which is exactly the worker exit condition.
+      auto first = queue_.WaitAndPop();
+      if (!first.has_value()) {
+        return;
+      }
+      batch.clear();
+      batch.push_back(std::move(*first));
+      for (auto& val : queue_.PopBatch(max_batch_ - 1)) {
+        batch.push_back(std::move(val));
+      }
+      sink_(std::span<In>(batch));
+    }
+  }
+
+  Queue<In, Alloc> queue_;
+  std::function<void(std::span<In>)> sink_;
+  uint64_t max_batch_;
+  std::vector<std::thread> workers_;
+};
+
+// Sink landing pair batches in a shared Map. Map::InsertBatch groups each
+// batch by destination bucket, so a bucket lock is taken once per batch
+// instead of once per record:
+//
+//   Map<uint64_t, Record> map;
+//   PipelineStage<std::pair<uint64_t, Record>> stage(4, MapSink(map));
+template <typename Key, typename Value, typename Hash = FastHash,
+          template <typename> typename Alloc = DefaultAllocator,
+          typename LockPolicy = DefaultLockPolicy>
+class MapSink {
+ public:
+  explicit MapSink(Map<Key, Value, Hash, Alloc, LockPolicy>& map,
+                   bool replace = false)
+      : map_(&map), replace_(replace) {}
+
+  void operator()(std::span<std::pair<Key, Value>> batch) const {
+    map_->InsertBatch(batch, replace_);
+  }
+
+ private:
+  Map<Key, Value, Hash, Alloc, LockPolicy>* map_;
+  bool replace_;
+};
+
+#endif  // THREADSAFE__PIPELINE_H_
@@ -0,0 +1,95 @@
+#ifndef THREADSAFE__POOL_ALLOCATOR_H_
+#define THREADSAFE__POOL_ALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Default node allocation strategy: plain new/delete.
+template <typename T>
+struct DefaultAllocator {
+  template <typename... Args>
+  static T* New(Args&&... args) {
+    return new T(std::forward<Args>(args)...);
+  }
+  static void Delete(T* ptr) { delete ptr; }
+};
+
+// Recycles fixed-size blocks through a thread-local free list, so
+// steady-state push/pop and insert/erase churn does no malloc/free.
+// Blocks freed on a thread land on that thread's list and are handed out
+// again from there; each list returns its blocks to the system on thread
+// exit.
+template <typename T>
+class PoolAllocator {
+ public:
+  template <typename... Args>
+  static T* New(Args&&... args) {
+    void* block = free_list_.Take();
+    if (block == nullptr) {
+      block = ::operator new(sizeof(T), std::align_val_t{alignof(T)});
+    }
+    try {
+      return ::new (block) T(std::forward<Args>(args)...);
+    } catch (...) {
+      free_list_.Put(block);
+      throw;
+    }
+  }
+
+  static void Delete(T* ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    ptr->~T();
+    free_list_.Put(ptr);
+  }
+
+ private:
+  static_assert(sizeof(T) >= sizeof(void*));
+
+  class FreeList {
+   public:
+    FreeList() = default;
+    ~FreeList() {
+      while (Block* block = head_) {
+        head_ = block->next;
+        ::operator delete(block, std::align_val_t{alignof(T)});
+      }
+    }
+
+    void* Take() {
+      Block* block = head_;
+      if (block != nullptr) {
+        head_ = block->next;
+      }
+      return block;
+    }
+
+    void Put(void* ptr) {
+      Block* block = static_cast<Block*>(ptr);
+      block->next = head_;
+      head_ = block;
+    }
+
+   private:
+    struct Block {
+      Block* next;
+    };
+
+    Block* head_ = nullptr;
+  };
+
+  static thread_local FreeList free_list_;
+};
+
+template <typename T>
+thread_local typename PoolAllocator<T>::FreeList PoolAllocator<T>::free_list_;
+
+// Adapts an Alloc to std::unique_ptr.
+template <typename T, template <typename> typename Alloc>
+struct AllocDeleter {
+  void operator()(T* ptr) const { Alloc<T>::Delete(ptr); }
+};
+
+#endif  // THREADSAFE__POOL_ALLOCATOR_H_
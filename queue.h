@@ -1,102 +1,639 @@
 #ifndef THREADSAFE__QUEUE_H_
 #define THREADSAFE__QUEUE_H_
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <coroutine>
+#include <functional>
 #include <mutex>
+#include <new>
 #include <optional>
 #include <queue>
+#include <vector>
 
-template <typename T>
+#include "pool_allocator.h"
+
+template <typename T, template <typename> typename Alloc = DefaultAllocator,
+          uint64_t SegmentSize = 32>
 class Queue {
+  static_assert(SegmentSize > 0);
+
+  struct Node;
+  using NodePtr = std::unique_ptr<Node, AllocDeleter<Node, Alloc>>;
+  // Segment of SegmentSize value slots: one allocation and one pointer
+  // chase per segment instead of per element. Slots [0, count) hold
+  // constructed values; in the head segment the first head_idx_ of them
+  // are already popped. count is written under tm_ and read by consumers
+  // either under tm_ (tail segment) or after the segment stopped being the
+  // tail, which the tail lock ordering makes safe.
   struct Node {
-    T value;
-    std::unique_ptr<Node> next;
+    T* Slot(uint64_t i) { return reinterpret_cast<T*>(slots) + i; }
+
+    alignas(alignof(T)) unsigned char slots[SegmentSize * sizeof(T)];
+    uint64_t count = 0;
+    NodePtr next;
   };
 
  public:
-  Queue() : head_(std::make_unique<Node>()), tail_(head_.get()) {}
+  // capacity = kUnbounded turns the bound (and producer blocking) off.
+  static constexpr uint64_t kUnbounded = 0;
 
-  Queue(const Queue<T>& other) = delete;
-  Queue& operator=(const Queue<T>& other) = delete;
+  explicit Queue(uint64_t capacity = kUnbounded)
+      : head_(Alloc<Node>::New()), tail_(head_.get()), capacity_(capacity) {}
+  ~Queue() { DestroyValues(); }
+
+  Queue(const Queue& other) = delete;
+  Queue& operator=(const Queue& other) = delete;
   Queue(Queue&& other) noexcept;
   Queue& operator=(Queue&& other) noexcept;
 
+  // Blocks while the queue is at capacity.
   void Push(T value);
-  T WaitAndPop();
+  // Fails fast instead of blocking when the queue is at capacity.
+  bool TryPush(T value);
+  // Push with a deadline; returns false if no room opened up in time.
+  template <typename Rep, typename Period>
+  bool PushWait(T value, const std::chrono::duration<Rep, Period>& timeout);
+  // Appends the whole range under one tail lock and one wakeup. On a
+  // bounded queue, waits for room for the whole batch; a batch larger than
+  // the capacity goes through once the queue is empty rather than
+  // deadlocking.
+  template <typename It>
+  void PushBatch(It first, It last);
+  // Blocks until a value arrives or the queue is closed and drained, in
+  // which case it returns nullopt.
+  std::optional<T> WaitAndPop();
+  // Same with a deadline; nullopt on timeout too.
+  template <typename Rep, typename Period>
+  std::optional<T> WaitAndPop(const std::chrono::duration<Rep, Period>& timeout);
   std::optional<T> TryPop();
+
+  // co_await queue.AsyncPop() completes with the popped value, or nullopt
+  // once the queue is closed and drained — WaitAndPop without the blocked
+  // thread. A suspended consumer sits in an intrusive waiter list (no
+  // allocation); the delivering push pops the value on its behalf and
+  // resumes it. A parked awaiter must be resumed before its coroutine
+  // frame is destroyed.
+  class PopAwaiter {
+   public:
+    explicit PopAwaiter(Queue& queue) : queue_(queue) {}
+
+    bool await_ready() { return queue_.AsyncReady(*this); }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      return queue_.AsyncPark(*this, handle);
+    }
+    std::optional<T> await_resume() { return std::move(value_); }
+
+   private:
+    friend class Queue;
+
+    Queue& queue_;
+    std::optional<T> value_;
+    std::coroutine_handle<> handle_;
+    PopAwaiter* next_ = nullptr;
+  };
+
+  PopAwaiter AsyncPop() { return PopAwaiter(*this); }
+
+  // Routes coroutine resumption through executor(handle) instead of
+  // resuming inline on the pushing (or closing) thread. Not threadsafe:
+  // configure before producers and consumers start.
+  void SetExecutor(std::function<void(std::coroutine_handle<>)> executor) {
+    executor_ = std::move(executor);
+  }
+
+  // Pop up to n values under one head lock.
+  std::vector<T> PopBatch(uint64_t n);
+  // Move everything currently queued into container (via push_back).
+  template <typename Container>
+  void DrainInto(Container& container);
   [[nodiscard]] bool Empty() const;
+  // Relaxed; exact only while nothing is in flight.
+  [[nodiscard]] uint64_t Length() const {
+    return len_.load(std::memory_order_relaxed);
+  }
+
+  // Shuts the queue down: blocked producers and consumers wake up, later
+  // pushes are dropped (TryPush/PushWait return false) and pops drain what
+  // is already queued before returning nullopt. Irreversible.
+  void Close();
+  [[nodiscard]] bool Closed() const {
+    return closed_.load(std::memory_order_relaxed);
+  }
+
+  // Invokes callback(length) whenever a push takes the length from below
+  // mark to mark or above. Runs on the pushing thread, outside the queue
+  // locks. Not threadsafe: configure before producers start.
+  void SetWatermark(uint64_t mark, std::function<void(uint64_t)> callback) {
+    watermark_ = mark;
+    watermark_cb_ = std::move(callback);
+  }
+
+#ifdef THREADSAFE_STATS
+  struct Stats {
+    uint64_t pushes = 0;
+    uint64_t pops = 0;
+    // Largest push/pop delta observed; how deep the queue has ever been.
+    uint64_t high_water = 0;
+  };
+  Stats GetStats() const {
+    Stats stats;
+    stats.pushes = stat_pushes_.load();
+    stats.pops = stat_pops_.load();
+    stats.high_water = stat_high_water_.load();
+    return stats;
+  }
+#endif
 
  private:
-  Node* GetTail();
+  // Tail pointer and its fill level, captured under one tm_ acquisition.
+  struct TailState {
+    Node* node;
+    uint64_t count;
+  };
+
+  TailState GetTail() const {
+    std::scoped_lock lock(tm_);
+    return {tail_, tail_->count};
+  }
+
+  // Callers hold tm_. Makes room for one more value at the tail.
+  void ReadyTailLocked() {
+    if (tail_->count == SegmentSize) {
+      tail_->next = NodePtr(Alloc<Node>::New());
+      tail_ = tail_->next.get();
+    }
+  }
+  // Callers hold hm_. Positions head_/head_idx_ on the next live slot;
+  // false means the queue is empty. Non-tail segments are always full, so
+  // at most one hop is needed.
+  bool ReadyHead() {
+    TailState tail = GetTail();
+    if (head_.get() != tail.node && head_idx_ == SegmentSize) {
+      head_ = std::move(head_->next);
+      head_idx_ = 0;
+    }
+    const uint64_t avail =
+        (head_.get() == tail.node) ? tail.count : head_->count;
+    return head_idx_ < avail;
+  }
+  // Callers hold hm_ and have seen ReadyHead() return true.
+  T TakeHead() {
+    T* slot = head_->Slot(head_idx_);
+    T val = std::move(*slot);
+    slot->~T();
+    ++head_idx_;
+    return val;
+  }
+  // Destroys the values still queued; the segment chain itself is owned by
+  // the NodePtrs.
+  void DestroyValues() {
+    uint64_t idx = head_idx_;
+    for (Node* n = head_.get(); n != nullptr; n = n->next.get()) {
+      for (uint64_t i = idx; i < n->count; ++i) {
+        n->Slot(i)->~T();
+      }
+      idx = 0;
+    }
+  }
+
+  // Awaiter fast path: complete without suspending when a value (or the
+  // closed-and-drained state) is available now.
+  bool AsyncReady(PopAwaiter& awaiter) {
+    std::scoped_lock lk(hm_);
+    if (ReadyHead()) {
+      awaiter.value_ = TakeHead();
+      NotePopped(1);
+      return true;
+    }
+    return Closed();
+  }
+  // Awaiter slow path: recheck under hm_ (a push may have landed since
+  // await_ready) and park; false resumes the coroutine immediately.
+  bool AsyncPark(PopAwaiter& awaiter, std::coroutine_handle<> handle) {
+    std::scoped_lock lk(hm_);
+    // Raise the counter before the readiness check. ReadyHead acquires
+    // tm_, so the two races resolve cleanly: a push that published before
+    // our tm_ acquisition is seen by the check below (no park), and a push
+    // whose tm_ section comes after it observes the increment in its
+    // WakeAsync load (both seq_cst) and takes the head lock to deliver.
+    // Incrementing after the check would leave a window where the pusher
+    // reads a stale zero and skips the wake, stranding the parked
+    // coroutine.
+    async_waiters_.fetch_add(1, std::memory_order_seq_cst);
+    if (ReadyHead()) {
+      async_waiters_.fetch_sub(1, std::memory_order_relaxed);
+      awaiter.value_ = TakeHead();
+      NotePopped(1);
+      return false;
+    }
+    if (Closed()) {
+      async_waiters_.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+    awaiter.handle_ = handle;
+    awaiter.next_ = nullptr;
+    if (async_tail_ == nullptr) {
+      async_head_ = &awaiter;
+    } else {
+      async_tail_->next_ = &awaiter;
+    }
+    async_tail_ = &awaiter;
+    return true;
+  }
+  // Hands queued values to parked coroutines; runs after a push or close,
+  // outside the queue locks. Waiter and value are paired under hm_, so a
+  // resumed coroutine never races another consumer for its value; the
+  // resumptions themselves happen outside the locks.
+  void WakeAsync() {
+    // Runs after the push's tm_ section; paired with the seq_cst increment
+    // in AsyncPark (see there), a zero here proves no coroutine that
+    // missed our value is parked, so the head lock can be skipped.
+    if (async_waiters_.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+    PopAwaiter* ready = nullptr;
+    PopAwaiter* ready_tail = nullptr;
+    {
+      std::scoped_lock lk(hm_);
+      uint64_t popped = 0;
+      while (async_head_ != nullptr) {
+        if (ReadyHead()) {
+          async_head_->value_ = TakeHead();
+          ++popped;
+        } else if (!Closed()) {
+          break;
+        }
+        PopAwaiter* w = async_head_;
+        async_head_ = w->next_;
+        if (async_head_ == nullptr) {
+          async_tail_ = nullptr;
+        }
+        async_waiters_.fetch_sub(1, std::memory_order_relaxed);
+        w->next_ = nullptr;
+        if (ready_tail == nullptr) {
+          ready = w;
+        } else {
+          ready_tail->next_ = w;
+        }
+        ready_tail = w;
+      }
+      NotePopped(popped);
+    }
+    while (ready != nullptr) {
+      // The frame may be destroyed inside resume; step off first.
+      PopAwaiter* next = ready->next_;
+      if (executor_) {
+        executor_(ready->handle_);
+      } else {
+        ready->handle_.resume();
+      }
+      ready = next;
+    }
+  }
+
+  // Fires the watermark callback when a push crosses the mark upward.
+  void NotifyWatermark(uint64_t before, uint64_t after) {
+    if (watermark_ != 0 && before < watermark_ && after >= watermark_) {
+      watermark_cb_(after);
+    }
+  }
+  // Bookkeeping after popping n values: length, stats, producer wakeup.
+  void NotePopped(uint64_t n) {
+    if (n == 0) {
+      return;
+    }
+    StatPop(n);
+    if (capacity_ == kUnbounded) {
+      len_.fetch_sub(n, std::memory_order_relaxed);
+      return;
+    }
+    {
+      // The decrement must be ordered with respect to tm_: a blocked
+      // producer checks Length() under tm_, and a bare decrement+notify
+      // landing between that check and its sleep would be lost — with no
+      // later pop to retry the wakeup, the producer stalls on free
+      // capacity. Holding tm_ here means the producer either sees the new
+      // length at its check or is already asleep when we notify.
+      std::scoped_lock lock(tm_);
+      len_.fetch_sub(n, std::memory_order_relaxed);
+    }
+    if (n == 1) {
+      not_full_.notify_one();
+    } else {
+      not_full_.notify_all();
+    }
+  }
+
+  // No-ops (and no storage) unless THREADSAFE_STATS is set.
+  void StatPush(uint64_t n) {
+#ifdef THREADSAFE_STATS
+    uint64_t pushes =
+        stat_pushes_.fetch_add(n, std::memory_order_relaxed) + n;
+    uint64_t depth = pushes - stat_pops_.load(std::memory_order_relaxed);
+    uint64_t high = stat_high_water_.load(std::memory_order_relaxed);
+    while (depth > high &&
+           !stat_high_water_.compare_exchange_weak(high, depth)) {
+    }
+#else
+    (void)n;
+#endif
+  }
+  void StatPop(uint64_t n) {
+#ifdef THREADSAFE_STATS
+    stat_pops_.fetch_add(n, std::memory_order_relaxed);
+#else
+    (void)n;
+#endif
+  }
 
-  std::unique_ptr<Node> head_;
+#ifdef THREADSAFE_STATS
+  std::atomic<uint64_t> stat_pushes_ = 0;
+  std::atomic<uint64_t> stat_pops_ = 0;
+  std::atomic<uint64_t> stat_high_water_ = 0;
+#endif
+
+  NodePtr head_;
+  // Pop cursor within the head segment; guarded by hm_.
+  uint64_t head_idx_ = 0;
   Node* tail_;
+  uint64_t capacity_;
+  // Pushed under tm_, popped under hm_; atomic so either side can read it
+  // without taking the other lock.
+  std::atomic<uint64_t> len_ = 0;
+  uint64_t watermark_ = 0;
+  std::function<void(uint64_t)> watermark_cb_;
+  std::atomic<bool> closed_ = false;
+  // Intrusive FIFO of parked AsyncPop awaiters; guarded by hm_. The
+  // counter lets pushes skip the head lock while nobody is parked.
+  PopAwaiter* async_head_ = nullptr;
+  PopAwaiter* async_tail_ = nullptr;
+  std::atomic<uint64_t> async_waiters_ = 0;
+  std::function<void(std::coroutine_handle<>)> executor_;
   mutable std::mutex hm_;
   mutable std::mutex tm_;
   std::condition_variable cv_;
+  // Producer side: waited on by pushes blocked on capacity_.
+  std::condition_variable not_full_;
 };
 
-template <typename T>
-void Queue<T>::Push(T value) {
-  std::unique_ptr<Node> node = std::make_unique<Node>();
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+void Queue<T, Alloc, SegmentSize>::Push(T value) {
+  uint64_t len = 0;
+  {
+    std::unique_lock lock(tm_);
+    if (capacity_ != kUnbounded) {
+      not_full_.wait(lock,
+                     [this]() { return Length() < capacity_ || Closed(); });
+    }
+    if (Closed()) {
+      return;
+    }
+    ReadyTailLocked();
+    new (tail_->Slot(tail_->count)) T(std::move(value));
+    ++tail_->count;
+    len = len_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  StatPush(1);
+  cv_.notify_one();
+  WakeAsync();
+  NotifyWatermark(len - 1, len);
+}
+
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+bool Queue<T, Alloc, SegmentSize>::TryPush(T value) {
+  uint64_t len = 0;
   {
     std::scoped_lock lock(tm_);
-    tail_->value = std::move(value);
-    tail_->next = std::move(node);
-    tail_ = tail_->next.get();
+    if (Closed() || (capacity_ != kUnbounded && Length() >= capacity_)) {
+      return false;
+    }
+    ReadyTailLocked();
+    new (tail_->Slot(tail_->count)) T(std::move(value));
+    ++tail_->count;
+    len = len_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  StatPush(1);
+  cv_.notify_one();
+  WakeAsync();
+  NotifyWatermark(len - 1, len);
+  return true;
+}
+
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+template <typename Rep, typename Period>
+bool Queue<T, Alloc, SegmentSize>::PushWait(
+    T value, const std::chrono::duration<Rep, Period>& timeout) {
+  uint64_t len = 0;
+  {
+    std::unique_lock lock(tm_);
+    if (capacity_ != kUnbounded &&
+        !not_full_.wait_for(lock, timeout, [this]() {
+          return Length() < capacity_ || Closed();
+        })) {
+      return false;
+    }
+    if (Closed()) {
+      return false;
+    }
+    ReadyTailLocked();
+    new (tail_->Slot(tail_->count)) T(std::move(value));
+    ++tail_->count;
+    len = len_.fetch_add(1, std::memory_order_relaxed) + 1;
   }
+  StatPush(1);
   cv_.notify_one();
+  WakeAsync();
+  NotifyWatermark(len - 1, len);
+  return true;
+}
+
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+template <typename It>
+void Queue<T, Alloc, SegmentSize>::PushBatch(It first, It last) {
+  if (first == last) {
+    return;
+  }
+  const auto n = static_cast<uint64_t>(std::distance(first, last));
+  uint64_t len = 0;
+  {
+    std::unique_lock lock(tm_);
+    if (capacity_ != kUnbounded) {
+      not_full_.wait(lock, [this, n]() {
+        return Length() + n <= capacity_ || Length() == 0 || Closed();
+      });
+    }
+    if (Closed()) {
+      return;
+    }
+    for (It it = first; it != last; ++it) {
+      ReadyTailLocked();
+      new (tail_->Slot(tail_->count)) T(*it);
+      ++tail_->count;
+    }
+    len = len_.fetch_add(n, std::memory_order_relaxed) + n;
+  }
+  StatPush(n);
+  cv_.notify_all();
+  WakeAsync();
+  NotifyWatermark(len - n, len);
 }
 
-template <typename T>
-T Queue<T>::WaitAndPop() {
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+std::optional<T> Queue<T, Alloc, SegmentSize>::WaitAndPop() {
   std::unique_lock lock(hm_);
-  cv_.wait(lock, [this]() { return head_.get() != GetTail(); });
-  auto val = std::move(head_->value);
-  head_ = std::move(head_->next);
+  cv_.wait(lock, [this]() { return ReadyHead() || Closed(); });
+  if (!ReadyHead()) {
+    return std::nullopt;
+  }
+  auto val = TakeHead();
+  NotePopped(1);
   return val;
 }
 
-template <typename T>
-std::optional<T> Queue<T>::TryPop() {
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+template <typename Rep, typename Period>
+std::optional<T> Queue<T, Alloc, SegmentSize>::WaitAndPop(
+    const std::chrono::duration<Rep, Period>& timeout) {
+  std::unique_lock lock(hm_);
+  if (!cv_.wait_for(lock, timeout,
+                    [this]() { return ReadyHead() || Closed(); })) {
+    return std::nullopt;
+  }
+  if (!ReadyHead()) {
+    return std::nullopt;
+  }
+  auto val = TakeHead();
+  NotePopped(1);
+  return val;
+}
+
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+void Queue<T, Alloc, SegmentSize>::Close() {
+  {
+    // Both locks, so no waiter can be between its predicate check and the
+    // sleep when the flag flips.
+    std::scoped_lock lock(hm_, tm_);
+    closed_.store(true, std::memory_order_relaxed);
+  }
+  cv_.notify_all();
+  not_full_.notify_all();
+  // Parked coroutines drain what is left or complete with nullopt.
+  WakeAsync();
+}
+
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+std::optional<T> Queue<T, Alloc, SegmentSize>::TryPop() {
   std::scoped_lock lk(hm_);
-  if (head_.get() == GetTail()) {
+  if (!ReadyHead()) {
     return std::nullopt;
   }
-  auto val = std::move(head_->value);
-  head_ = std::move(head_->next);
+  auto val = TakeHead();
+  NotePopped(1);
   return val;
 }
 
-template <typename T>
-bool Queue<T>::Empty() const {
-  std::scoped_lock lock(hm_, tm_);
-  return head_.get() == tail_;
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+std::vector<T> Queue<T, Alloc, SegmentSize>::PopBatch(uint64_t n) {
+  std::vector<T> out;
+  std::scoped_lock lk(hm_);
+  // One tail snapshot for the whole batch; whatever lands after it is for
+  // the next call.
+  TailState tail = GetTail();
+  for (;;) {
+    if (head_.get() != tail.node && head_idx_ == SegmentSize) {
+      head_ = std::move(head_->next);
+      head_idx_ = 0;
+    }
+    const uint64_t avail =
+        (head_.get() == tail.node) ? tail.count : head_->count;
+    while (out.size() < n && head_idx_ < avail) {
+      out.push_back(TakeHead());
+    }
+    if (out.size() == n || head_.get() == tail.node) {
+      break;
+    }
+  }
+  NotePopped(out.size());
+  return out;
 }
 
-template <typename T>
-typename Queue<T>::Node* Queue<T>::GetTail() {
-  std::scoped_lock lock(tm_);
-  return tail_;
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+template <typename Container>
+void Queue<T, Alloc, SegmentSize>::DrainInto(Container& container) {
+  std::scoped_lock lk(hm_);
+  TailState tail = GetTail();
+  uint64_t popped = 0;
+  for (;;) {
+    if (head_.get() != tail.node && head_idx_ == SegmentSize) {
+      head_ = std::move(head_->next);
+      head_idx_ = 0;
+    }
+    const uint64_t avail =
+        (head_.get() == tail.node) ? tail.count : head_->count;
+    while (head_idx_ < avail) {
+      container.push_back(TakeHead());
+      ++popped;
+    }
+    if (head_.get() == tail.node) {
+      break;
+    }
+  }
+  NotePopped(popped);
+}
+
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+bool Queue<T, Alloc, SegmentSize>::Empty() const {
+  std::scoped_lock lock(hm_, tm_);
+  const Node* n = head_.get();
+  uint64_t idx = head_idx_;
+  while (n != tail_ && idx == SegmentSize) {
+    n = n->next.get();
+    idx = 0;
+  }
+  return idx == n->count;
 }
 
-template <typename T>
-Queue<T>::Queue(Queue<T>&& other) noexcept {
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+Queue<T, Alloc, SegmentSize>::Queue(Queue&& other) noexcept {
   std::scoped_lock lk(other.hm_, other.tm_);
   head_ = std::move(other.head_);
+  head_idx_ = other.head_idx_;
+  other.head_idx_ = 0;
   tail_ = other.tail_;
   other.tail_ = nullptr;
+  capacity_ = other.capacity_;
+  len_.store(other.len_.load(std::memory_order_relaxed),
+             std::memory_order_relaxed);
+  watermark_ = other.watermark_;
+  watermark_cb_ = std::move(other.watermark_cb_);
+  executor_ = std::move(other.executor_);
+  closed_.store(other.closed_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
 }
 
-template <typename T>
-Queue<T>& Queue<T>::operator=(Queue<T> &&other) noexcept {
+template <typename T, template <typename> typename Alloc, uint64_t SegmentSize>
+Queue<T, Alloc, SegmentSize>& Queue<T, Alloc, SegmentSize>::operator=(
+    Queue&& other) noexcept {
   if (this == &other) {
     return *this;
   }
+  DestroyValues();
   std::scoped_lock lk(other.hm_, other.tm_);
   head_ = std::move(other.head_);
+  head_idx_ = other.head_idx_;
+  other.head_idx_ = 0;
   tail_ = other.tail_;
   other.tail_ = nullptr;
+  capacity_ = other.capacity_;
+  len_.store(other.len_.load(std::memory_order_relaxed),
+             std::memory_order_relaxed);
+  watermark_ = other.watermark_;
+  watermark_cb_ = std::move(other.watermark_cb_);
+  executor_ = std::move(other.executor_);
+  closed_.store(other.closed_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
   return *this;
 }
 
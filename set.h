@@ -1,32 +1,77 @@
 #ifndef THREADSAFE__SET_H_
 #define THREADSAFE__SET_H_
 
+#include <algorithm>
 #include <atomic>
+#include <fstream>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 
-template <typename Value, typename Hash = std::hash<Value>>
+#include "hash.h"
+#include "lock_policy.h"
+#include "pool_allocator.h"
+#include "sharded_counter.h"
+#include "snapshot.h"
+
+// The locking scheme is a compile-time policy (see lock_policy.h). The
+// default walks chains hand-over-hand on per-node locks; with a
+// bucket-only policy nodes carry no lock and every walk runs under the
+// bucket lock instead — cheaper when chains are short.
+template <typename Value, typename Hash = FastHash,
+          template <typename> typename Alloc = DefaultAllocator,
+          typename LockPolicy = DefaultLockPolicy>
 class Set {
+  using BucketMutex = typename LockPolicy::BucketMutex;
+  using NodeMutex = typename LockPolicy::NodeMutex;
+  static constexpr bool kPerNodeLocks = LockPolicy::kPerNodeLocks;
+
   struct Bucket {
+    struct Node;
+    using NodePtr = std::unique_ptr<Node, AllocDeleter<Node, Alloc>>;
     struct Node {
       template <typename Val>
         requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
                  std::is_convertible_v<Val, Value>
-      explicit Node(Val&& value) : value(std::forward<Val>(value)) {}
+      Node(uint64_t hash, Val&& value)
+          : hash(hash), value(std::forward<Val>(value)) {}
 
+      // Full hash, cached so chain steps compare integers before values and
+      // migration re-buckets without rehashing.
+      uint64_t hash;
       Value value;
-      mutable std::shared_mutex m;
-      std::unique_ptr<Node> next = nullptr;
+      // An empty struct when the policy is bucket-only.
+      [[no_unique_address]] mutable NodeMutex m;
+      NodePtr next = nullptr;
     };
 
-    // guards list head
-    mutable std::shared_mutex m;
-    std::unique_ptr<Node> head = nullptr;
+    // guards list head and the moved flag (the whole chain, in bucket-only
+    // mode)
+    mutable BucketMutex m;
+    NodePtr head = nullptr;
+    // Set once this bucket's chain has been migrated to the next table;
+    // operations that find it set follow table->next instead.
+    bool moved = false;
   };
   using Node = typename Bucket::Node;
+  using NodePtr = typename Bucket::NodePtr;
+
+  struct Table {
+    explicit Table(uint64_t size) : size(size), data(size) {}
+
+    uint64_t size;
+    std::vector<Bucket> data;
+    // Resize state; next is set once, when a migration begins.
+    std::atomic<Table*> next = nullptr;
+    std::atomic<uint64_t> migrate_pos = 0;
+    std::atomic<uint64_t> migrated = 0;
+  };
 
  public:
   explicit Set(uint64_t size = kDefaultSize);
@@ -35,184 +80,826 @@ class Set {
   Set(const Set& other) = delete;
   Set& operator=(const Set& other) = delete;
 
-  [[nodiscard]] bool Contains(const Value& value) const;
+  [[nodiscard]] bool Contains(const Value& value) const {
+    return ContainsImpl(value);
+  }
+
+  // Heterogeneous lookups: available when Hash is transparent and hashes K
+  // directly (see HashableAs), e.g. a std::string_view probe against a
+  // Set<std::string, StringHash>. No temporary Value is built.
+  template <typename K>
+    requires HashableAs<K, Value, Hash>
+  [[nodiscard]] bool Contains(const K& value) const {
+    return ContainsImpl(value);
+  }
 
   template <typename Val>
     requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
              std::is_convertible_v<Val, Value>
   void Insert(Val&& value);
-  bool Erase(const Value& value);
+  bool Erase(const Value& value) { return EraseImpl(value); }
+  template <typename K>
+    requires HashableAs<K, Value, Hash>
+  bool Erase(const K& value) { return EraseImpl(value); }
+
+  // Batched membership: out[i] gets the result for values[i] (out must be
+  // at least values.size() long). Hashes a window of values and prefetches
+  // their buckets before probing any of them, so independent probes overlap
+  // their cache misses instead of stalling one by one.
+  void ContainsMany(std::span<const Value> values, std::span<bool> out) const;
+
+  // Visits every value as func(value) under shared locks. Weakly
+  // consistent: values inserted, erased or migrated while the walk runs may
+  // be missed or visited twice. Quiesce writers for an exact pass.
+  template <typename Func>
+  void ForEach(Func&& func) const;
+  // Same contract with the bucket array split across n_threads; func is
+  // called concurrently and should be threadsafe.
+  template <typename Func>
+  void ParallelForEach(Func&& func, uint64_t n_threads) const;
+
+  // Writes a binary snapshot of the contents (see snapshot.h); requires a
+  // trivially copyable Value. Weakly consistent like ForEach, so quiesce
+  // writers for an exact snapshot. Returns false on I/O failure.
+  bool Serialize(const std::string& path) const;
 
   [[nodiscard]] uint64_t Size() const;
 
+#ifdef THREADSAFE_STATS
+  struct Stats {
+    // chain_histogram[n] = buckets with chain length n; lengths >=
+    // kStatsMaxChain share the last slot.
+    std::vector<uint64_t> chain_histogram;
+    uint64_t max_chain = 0;
+    // Bucket-lock acquisitions that had to wait since construction.
+    uint64_t lock_waits = 0;
+  };
+  // Snapshot; walks every bucket under shared locks, so not a hot-path call.
+  Stats GetStats() const;
+#endif
+
+  // Threadsafe: migrates one bucket at a time while lookups and writes keep
+  // serving; operations that land on a migrated bucket follow it to the new
+  // table. If a resize is already running, joins it instead of starting a
+  // second one. Returns once the new table is fully in place.
+  void Resize();
+  void Resize(uint64_t new_size);
+
   // Not threadsafe.
   Set(Set&& other) noexcept;
   Set& operator=(Set&& other) noexcept;
-  void Resize();
-  void Resize(uint64_t new_size);
   void FastInsert(Value&& value);
+  // Replaces the contents with the range, pre-sized for it. Hashes are
+  // computed in one parallel pass, then each thread owns a contiguous
+  // bucket range and links only the values landing in it, so loading takes
+  // no locks at all.
+  template <typename It>
+  void BuildFrom(It first, It last,
+                 uint64_t n_threads = std::thread::hardware_concurrency());
+  // Replaces the contents with a snapshot written by Serialize. Returns
+  // false on I/O or format errors, leaving the contents untouched.
+  bool Deserialize(const std::string& path);
 
  private:
   static constexpr int kDefaultSize = 55001;
+  static constexpr uint64_t kMaxLoadFactor = 2;
+  static constexpr uint64_t kMigrateBatch = 8;
+  // Writes per thread between load-factor checks: summing the sharded
+  // counter touches every stripe other writers are dirtying, so the check
+  // must stay off the per-write path.
+  static constexpr uint64_t kGrowCheckEvery = 64;
+  // ContainsMany pipeline window; big enough to overlap misses, small
+  // enough to stay in the prefetchers' reach.
+  static constexpr uint64_t kProbeBatch = 32;
+#ifdef THREADSAFE_STATS
+  static constexpr uint64_t kStatsMaxChain = 16;
+#endif
+
+  // Bucket-lock entry points; compiled down to plain lock calls unless
+  // THREADSAFE_STATS is set, in which case contested acquisitions are
+  // counted.
+  std::shared_lock<BucketMutex> SharedLockBucket(const Bucket& bucket) const {
+#ifdef THREADSAFE_STATS
+    std::shared_lock lk(bucket.m, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      ++lock_waits_;
+      lk.lock();
+    }
+    return lk;
+#else
+    return std::shared_lock(bucket.m);
+#endif
+  }
+  std::unique_lock<BucketMutex> UniqueLockBucket(Bucket& bucket) {
+#ifdef THREADSAFE_STATS
+    std::unique_lock lk(bucket.m, std::try_to_lock);
+    if (!lk.owns_lock()) {
+      ++lock_waits_;
+      lk.lock();
+    }
+    return lk;
+#else
+    return std::unique_lock(bucket.m);
+#endif
+  }
+
+  // Shared walk bodies behind both the exact-Value and the heterogeneous
+  // overloads; K is anything Hash can hash that compares against Value.
+  template <typename K>
+  bool ContainsImpl(const K& value) const;
+  // Single probe with a precomputed hash.
+  template <typename K>
+  bool ContainsHashed(uint64_t h, const K& value) const;
+  template <typename K>
+  bool EraseImpl(const K& value);
+
+  // Single-threaded chain append shared by FastInsert and BuildFrom.
+  void UnlockedInsert(Table& table, uint64_t h, Value&& value);
+
+  // Visits buckets [lo, hi) of one table with the same hand-over-hand walk
+  // as Contains; shared by ForEach and ParallelForEach.
+  template <typename Func>
+  void ForEachBucketRange(const Table& table, uint64_t lo, uint64_t hi,
+                          Func& func) const;
 
-  uint64_t size_;
-  std::atomic<uint64_t> count_ = 0;
-  std::vector<Bucket> data_;
+  // Drains one bucket into its positions in next under the bucket's writer
+  // lock, then marks it moved.
+  void MigrateBucket(Bucket& bucket, Table& next);
+  // Claims and migrates up to max_buckets pending buckets of table's
+  // in-progress resize (if any); whoever finishes the last bucket publishes
+  // the new table.
+  void HelpMigrate(Table* table, uint64_t max_buckets);
+  // Starts a doubling once the average chain length passes kMaxLoadFactor,
+  // and chips in a few buckets whenever a migration is pending, so growth is
+  // amortized across writers instead of stalling one of them.
+  void MaybeGrow(Table* table);
+
+  // Operations hold raw Table pointers without pinning them, so every table
+  // this container ever created stays owned here until destruction; retired
+  // tables have already handed their nodes over and keep only the empty
+  // bucket array.
+  std::atomic<Table*> table_;
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::mutex tables_m_;
+  ShardedCounter count_;
   Hash hash_;
+#ifdef THREADSAFE_STATS
+  mutable ShardedCounter lock_waits_;
+#endif
 };
 
-template <typename Value, typename Hash>
-Set<Value, Hash>::Set(uint64_t size) : size_(size), data_(size_) {}
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Set<Value, Hash, Alloc, LockPolicy>::Set(uint64_t size)
+    : table_(nullptr) {
+  tables_.push_back(std::make_unique<Table>(size));
+  table_.store(tables_.back().get());
+}
 
-template <typename Value, typename Hash>
-bool Set<Value, Hash>::Contains(const Value& value) const {
-  uint64_t h = hash_(value) % size_;
-  auto& bucket = data_[h];
-  std::shared_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+bool Set<Value, Hash, Alloc, LockPolicy>::ContainsImpl(const K& value) const {
+  return ContainsHashed(hash_(value), value);
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+bool Set<Value, Hash, Alloc, LockPolicy>::ContainsHashed(uint64_t h,
+                                             const K& value) const {
+  Table* table = table_.load();
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = SharedLockBucket(bucket);
+    if (bucket.moved) {
+      table = table->next.load();
+      continue;
+    }
+    if (bucket.head == nullptr) {
+      return false;
+    }
+    if constexpr (kPerNodeLocks) {
+      Node* n = bucket.head.get();
+      if (n->hash == h && n->value == value) {
+        return true;
+      }
+      Node* next = nullptr;
+      while ((next = n->next.get()) != nullptr) {
+        std::shared_lock n_lk(next->m);
+        lk.unlock();
+        if (next->hash == h && next->value == value) {
+          return true;
+        }
+        n = next;
+        lk = std::move(n_lk);
+      }
+    } else {
+      // Bucket-only mode: lk covers the whole chain, so a plain walk
+      // replaces the hand-over-hand coupling.
+      for (const Node* n = bucket.head.get(); n != nullptr;
+           n = n->next.get()) {
+        if (n->hash == h && n->value == value) {
+          return true;
+        }
+      }
+    }
     return false;
   }
-  Node* n = bucket.head.get();
-  if (n->value == value) {
-    return true;
-  }
-  Node* next = nullptr;
-  while ((next = n->next.get()) != nullptr) {
-    std::shared_lock n_lk(next->m);
-    lk.unlock();
-    if (next->value == value) {
-      return true;
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::ContainsMany(std::span<const Value> values,
+                                           std::span<bool> out) const {
+  uint64_t hashes[kProbeBatch];
+  for (uint64_t base = 0; base < values.size(); base += kProbeBatch) {
+    const uint64_t n = std::min(kProbeBatch, values.size() - base);
+    Table* table = table_.load();
+    for (uint64_t i = 0; i < n; ++i) {
+      hashes[i] = hash_(values[base + i]);
+      __builtin_prefetch(&table->data[FastRange(hashes[i], table->size)]);
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      out[base + i] = ContainsHashed(hashes[i], values[base + i]);
     }
-    n = next;
-    lk = std::move(n_lk);
   }
-  return false;
 }
 
-template <typename Value, typename Hash>
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
 template <typename Val>
   requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
            std::is_convertible_v<Val, Value>
-void Set<Value, Hash>::Insert(Val&& value) {
-  std::unique_ptr<Node> new_node =
-      std::make_unique<Node>(std::forward<Val>(value));
-  uint64_t h = hash_(value) % size_;
-  auto& bucket = data_[h];
-  std::unique_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
-    bucket.head = std::move(new_node);
+void Set<Value, Hash, Alloc, LockPolicy>::Insert(Val&& value) {
+  const uint64_t h = hash_(value);
+  NodePtr new_node(Alloc<Node>::New(h, std::forward<Val>(value)));
+  Table* table = table_.load();
+  MaybeGrow(table);
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved) {
+      table = table->next.load();
+      continue;
+    }
+    if (bucket.head == nullptr) {
+      bucket.head = std::move(new_node);
+      ++count_;
+      return;
+    }
+    if constexpr (kPerNodeLocks) {
+      Node* n = bucket.head.get();
+      if (n->hash == h && n->value == new_node->value) {
+        return;
+      }
+      Node* next = nullptr;
+      while ((next = n->next.get()) != nullptr) {
+        std::unique_lock n_lk(next->m);
+        lk.unlock();
+        if (next->hash == h && next->value == new_node->value) {
+          return;
+        }
+        n = next;
+        lk = std::move(n_lk);
+      }
+      n->next = std::move(new_node);
+    } else {
+      Node* n = bucket.head.get();
+      for (;;) {
+        if (n->hash == h && n->value == new_node->value) {
+          return;
+        }
+        if (n->next == nullptr) {
+          break;
+        }
+        n = n->next.get();
+      }
+      n->next = std::move(new_node);
+    }
     ++count_;
     return;
   }
-  Node* n = bucket.head.get();
-  if (n->value == value) {
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename K>
+bool Set<Value, Hash, Alloc, LockPolicy>::EraseImpl(const K& value) {
+  const uint64_t h = hash_(value);
+  Table* table = table_.load();
+  for (;;) {
+    auto& bucket = table->data[FastRange(h, table->size)];
+    auto lk = UniqueLockBucket(bucket);
+    if (bucket.moved) {
+      table = table->next.load();
+      continue;
+    }
+    if (bucket.head == nullptr) {
+      return false;
+    }
+    Node* node = bucket.head.get();
+    if (node->hash == h && node->value == value) {
+      bucket.head = std::move(node->next);
+      --count_;
+      return true;
+    }
+    if constexpr (kPerNodeLocks) {
+      Node* next = nullptr;
+      while ((next = node->next.get()) != nullptr) {
+        std::unique_lock n_lk(next->m);
+        if (next->hash == h && next->value == value) {
+          // Keep the node alive until its mutex is unlocked.
+          NodePtr dead = std::move(node->next);
+          node->next = std::move(dead->next);
+          --count_;
+          n_lk.unlock();
+          return true;
+        }
+        lk.unlock();
+        node = next;
+        lk = std::move(n_lk);
+      }
+    } else {
+      for (Node* next = node->next.get(); next != nullptr;
+           node = next, next = next->next.get()) {
+        if (next->hash == h && next->value == value) {
+          NodePtr dead = std::move(node->next);
+          node->next = std::move(dead->next);
+          --count_;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func>
+void Set<Value, Hash, Alloc, LockPolicy>::ForEach(Func&& func) const {
+  // During a migration values are spread over the table list; every value
+  // sits in exactly one bucket that is not yet moved.
+  for (Table* table = table_.load(); table != nullptr;
+       table = table->next.load()) {
+    ForEachBucketRange(*table, 0, table->size, func);
+  }
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func>
+void Set<Value, Hash, Alloc, LockPolicy>::ParallelForEach(Func&& func,
+                                              uint64_t n_threads) const {
+  if (n_threads <= 1) {
+    ForEach(std::forward<Func>(func));
     return;
   }
-  Node* next = nullptr;
-  while ((next = n->next.get()) != nullptr) {
-    std::unique_lock n_lk(next->m);
-    lk.unlock();
-    if (next->value == value) {
-      return;
+  std::vector<std::thread> workers;
+  workers.reserve(n_threads);
+  for (uint64_t t = 0; t < n_threads; ++t) {
+    workers.emplace_back([this, &func, n_threads, t]() {
+      for (Table* table = table_.load(); table != nullptr;
+           table = table->next.load()) {
+        ForEachBucketRange(*table, t * table->size / n_threads,
+                           (t + 1) * table->size / n_threads, func);
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename Func>
+void Set<Value, Hash, Alloc, LockPolicy>::ForEachBucketRange(const Table& table,
+                                                 uint64_t lo, uint64_t hi,
+                                                 Func& func) const {
+  for (uint64_t i = lo; i < hi; ++i) {
+    const Bucket& bucket = table.data[i];
+    auto lk = SharedLockBucket(bucket);
+    if (bucket.moved) {
+      continue;
+    }
+    // Values are const through the walk: mutating one would break hashing.
+    const Node* n = bucket.head.get();
+    if (n == nullptr) {
+      continue;
+    }
+    if constexpr (kPerNodeLocks) {
+      func(n->value);
+      const Node* next = nullptr;
+      while ((next = n->next.get()) != nullptr) {
+        std::shared_lock n_lk(next->m);
+        lk.unlock();
+        func(next->value);
+        n = next;
+        lk = std::move(n_lk);
+      }
+    } else {
+      for (; n != nullptr; n = n->next.get()) {
+        func(n->value);
+      }
     }
-    n = next;
-    lk = std::move(n_lk);
   }
-  n->next = std::move(new_node);
-  ++count_;
 }
 
-template <typename Value, typename Hash>
-bool Set<Value, Hash>::Erase(const Value& value) {
-  auto h = hash_(value) % size_;
-  auto& bucket = data_[h];
-  std::unique_lock lk(bucket.m);
-  if (bucket.head == nullptr) {
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+bool Set<Value, Hash, Alloc, LockPolicy>::Serialize(const std::string& path) const {
+  static_assert(std::is_trivially_copyable_v<Value>,
+                "snapshots need trivially copyable values");
+  using Entry = SnapshotSetEntry<Value>;
+  // Group by destination bucket first so the file can carry a per-bucket
+  // offset index for the mapped view.
+  const uint64_t buckets = table_.load()->size;
+  std::vector<std::vector<Entry>> groups(buckets);
+  uint64_t total = 0;
+  for (const Table* table = table_.load(); table != nullptr;
+       table = table->next.load()) {
+    for (uint64_t i = 0; i < table->size; ++i) {
+      const Bucket& bucket = table->data[i];
+      auto lk = SharedLockBucket(bucket);
+      if (bucket.moved) {
+        continue;
+      }
+      const Node* n = bucket.head.get();
+      if (n == nullptr) {
+        continue;
+      }
+      if constexpr (kPerNodeLocks) {
+        groups[FastRange(n->hash, buckets)].push_back({n->hash, n->value});
+        ++total;
+        const Node* next = nullptr;
+        while ((next = n->next.get()) != nullptr) {
+          std::shared_lock n_lk(next->m);
+          lk.unlock();
+          groups[FastRange(next->hash, buckets)].push_back(
+              {next->hash, next->value});
+          ++total;
+          n = next;
+          lk = std::move(n_lk);
+        }
+      } else {
+        for (; n != nullptr; n = n->next.get()) {
+          groups[FastRange(n->hash, buckets)].push_back({n->hash, n->value});
+          ++total;
+        }
+      }
+    }
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
     return false;
   }
-  Node* node = bucket.head.get();
-  if (node->value == value) {
-    bucket.head = std::move(node->next);
-    --count_;
-    return true;
-  }
-  Node* next = nullptr;
-  while ((next = node->next.get()) != nullptr) {
-    std::unique_lock n_lk(next->m);
-    if (next->value == value) {
-      node->next = std::move(next->next);
-      --count_;
-      return true;
+  SnapshotHeader header{kSnapshotMagic, kSnapshotVersion, buckets, total};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t off = 0;
+  for (const auto& group : groups) {
+    out.write(reinterpret_cast<const char*>(&off), sizeof(off));
+    off += group.size();
+  }
+  out.write(reinterpret_cast<const char*>(&off), sizeof(off));
+  const std::string pad(
+      SnapshotDataOffset(buckets, alignof(Entry)) -
+          (sizeof(header) + (buckets + 1) * sizeof(uint64_t)),
+      '\0');
+  out.write(pad.data(), pad.size());
+  for (const auto& group : groups) {
+    out.write(reinterpret_cast<const char*>(group.data()),
+              group.size() * sizeof(Entry));
+  }
+  return static_cast<bool>(out);
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+bool Set<Value, Hash, Alloc, LockPolicy>::Deserialize(const std::string& path) {
+  static_assert(std::is_trivially_copyable_v<Value>,
+                "snapshots need trivially copyable values");
+  using Entry = SnapshotSetEntry<Value>;
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  SnapshotHeader header{};
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || header.magic != kSnapshotMagic ||
+      header.version != kSnapshotVersion || header.buckets == 0) {
+    return false;
+  }
+  // The header drives the allocations below, so bound its counts by the
+  // file's actual size first — a truncated or corrupt snapshot must fail
+  // cleanly, not throw from the allocator. MappedSnapshot::Open runs the
+  // same check against the mapped length.
+  in.seekg(0, std::ios::end);
+  const auto file_size = static_cast<uint64_t>(in.tellg());
+  if (header.buckets > (file_size - sizeof(SnapshotHeader)) / sizeof(uint64_t)) {
+    return false;
+  }
+  const uint64_t data_off = SnapshotDataOffset(header.buckets, alignof(Entry));
+  if (data_off > file_size ||
+      header.entries > (file_size - data_off) / sizeof(Entry)) {
+    return false;
+  }
+  in.seekg(data_off);
+  std::vector<Entry> entries(header.entries);
+  in.read(reinterpret_cast<char*>(entries.data()),
+          entries.size() * sizeof(Entry));
+  if (!in) {
+    return false;
+  }
+  tables_.clear();
+  tables_.push_back(std::make_unique<Table>(header.buckets));
+  table_.store(tables_.back().get());
+  count_ = ShardedCounter();
+  Table& table = *tables_.back();
+  for (const Entry& entry : entries) {
+    // The stored hash is reused directly; see the format note in snapshot.h.
+    UnlockedInsert(table, entry.hash, Value(entry.value));
+  }
+  return true;
+}
+
+#ifdef THREADSAFE_STATS
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+typename Set<Value, Hash, Alloc, LockPolicy>::Stats Set<Value, Hash, Alloc, LockPolicy>::GetStats()
+    const {
+  Stats stats;
+  stats.chain_histogram.assign(kStatsMaxChain + 1, 0);
+  stats.lock_waits = lock_waits_.Get();
+  // During a migration live chains are spread over the table list; every
+  // node sits in exactly one bucket that is not yet moved.
+  for (Table* table = table_.load(); table != nullptr;
+       table = table->next.load()) {
+    for (const Bucket& bucket : table->data) {
+      std::shared_lock lk(bucket.m);
+      if (bucket.moved) {
+        continue;
+      }
+      uint64_t len = 0;
+      if constexpr (kPerNodeLocks) {
+        // Same hand-over-hand walk as lookups: tail appends happen under
+        // node locks, so chains cannot be chased under the bucket lock
+        // alone.
+        Node* n = bucket.head.get();
+        if (n != nullptr) {
+          len = 1;
+          Node* next = nullptr;
+          while ((next = n->next.get()) != nullptr) {
+            std::shared_lock n_lk(next->m);
+            lk.unlock();
+            ++len;
+            n = next;
+            lk = std::move(n_lk);
+          }
+        }
+      } else {
+        for (const Node* n = bucket.head.get(); n != nullptr;
+             n = n->next.get()) {
+          ++len;
+        }
+      }
+      stats.max_chain = std::max(stats.max_chain, len);
+      ++stats.chain_histogram[std::min(len, kStatsMaxChain)];
     }
-    lk.unlock();
-    node = next;
-    lk = std::move(n_lk);
   }
-  return false;
+  return stats;
 }
+#endif
 
-template <typename Value, typename Hash>
-uint64_t Set<Value, Hash>::Size() const {
-  return count_;
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+uint64_t Set<Value, Hash, Alloc, LockPolicy>::Size() const {
+  return count_.Get();
 }
 
-template <typename Value, typename Hash>
-Set<Value, Hash>::Set(Set&& other) noexcept
-    : size_(other.size_), count_(other.count_), data_(std::move(other.data_)) {
-  other.size_ = 0;
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Set<Value, Hash, Alloc, LockPolicy>::Set(Set&& other) noexcept
+    : table_(other.table_.load()),
+      tables_(std::move(other.tables_)),
+      count_(std::move(other.count_)) {
+  other.table_.store(nullptr);
 }
 
-template <typename Value, typename Hash>
-Set<Value, Hash>& Set<Value, Hash>::operator=(Set&& other) noexcept {
-  if (*this == other) {
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+Set<Value, Hash, Alloc, LockPolicy>& Set<Value, Hash, Alloc, LockPolicy>::operator=(
+    Set&& other) noexcept {
+  if (this == &other) {
     return *this;
   }
-  size_ = other.size_;
-  count_ = other.count_;
-  data_ = std::move(other.data_);
-  other.size_ = 0;
+  table_.store(other.table_.load());
+  tables_ = std::move(other.tables_);
+  count_ = std::move(other.count_);
+  other.table_.store(nullptr);
   return *this;
 }
 
-template <typename Value, typename Hash>
-void Set<Value, Hash>::Resize() {
-  Resize(size_ * 2);
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::Resize() {
+  Resize(table_.load()->size * 2);
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::Resize(uint64_t new_size) {
+  Table* table = table_.load();
+  if (new_size == 0 || new_size == table->size) {
+    return;
+  }
+  {
+    std::scoped_lock lk(tables_m_);
+    // If a resize is already running, help it finish instead of starting a
+    // second one.
+    if (table->next.load() == nullptr) {
+      tables_.push_back(std::make_unique<Table>(new_size));
+      table->next.store(tables_.back().get());
+    }
+  }
+  HelpMigrate(table, table->size);
+  while (table_.load() == table) {
+    std::this_thread::yield();
+  }
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::MigrateBucket(Bucket& bucket, Table& next) {
+  std::unique_lock lk(bucket.m);
+  // Pop from the head one node at a time; each pop waits out any reader or
+  // writer still holding that node, so the chain is never overtaken.
+  while (bucket.head != nullptr) {
+    NodePtr node;
+    if constexpr (kPerNodeLocks) {
+      std::unique_lock n_lk(bucket.head->m);
+      node = std::move(bucket.head);
+      bucket.head = std::move(node->next);
+    } else {
+      // Bucket-only mode: the bucket lock held above already excludes every
+      // walker, so the pop needs no node lock.
+      node = std::move(bucket.head);
+      bucket.head = std::move(node->next);
+    }
+    // node is private now: detached from the old chain, not yet published.
+    auto& dst = next.data[FastRange(node->hash, next.size)];
+    std::unique_lock d_lk(dst.m);
+    node->next = std::move(dst.head);
+    dst.head = std::move(node);
+  }
+  bucket.moved = true;
 }
 
-template <typename Value, typename Hash>
-void Set<Value, Hash>::Resize(uint64_t new_size) {
-  if (new_size == 0) {
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::HelpMigrate(Table* table, uint64_t max_buckets) {
+  Table* next = table->next.load();
+  if (next == nullptr) {
     return;
   }
-  Set<Value, Hash> new_map(new_size);
-  std::for_each(data_.begin(), data_.end(), [&new_map](auto&& bucket) {
-    for (Node* node = bucket.head.get(); node != nullptr;
-         node = node->next.get()) {
-      new_map.FastInsert(std::move(node->value), std::move(node->value));
+  for (uint64_t done = 0; done < max_buckets; ++done) {
+    uint64_t i = table->migrate_pos.fetch_add(1);
+    if (i >= table->size) {
+      return;
+    }
+    MigrateBucket(table->data[i], *next);
+    if (table->migrated.fetch_add(1) + 1 == table->size) {
+      table_.store(next);
     }
-  });
-  *this = std::move(new_map);
+  }
+}
+
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::MaybeGrow(Table* table) {
+  if (table->next.load() == nullptr) {
+    // The countdown is thread-local and shared across instances, which only
+    // paces the check; the worst overshoot (threads * kGrowCheckEvery
+    // writes past the limit) is noise next to size * kMaxLoadFactor.
+    static thread_local uint64_t writes = 0;
+    if (++writes % kGrowCheckEvery != 0) {
+      return;
+    }
+    if (count_.Get() <= table->size * kMaxLoadFactor) {
+      return;
+    }
+    std::scoped_lock lk(tables_m_);
+    if (table->next.load() == nullptr) {
+      tables_.push_back(std::make_unique<Table>(table->size * 2));
+      table->next.store(tables_.back().get());
+    }
+  }
+  HelpMigrate(table, kMigrateBatch);
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::FastInsert(Value&& value) {
+  const uint64_t h = hash_(value);
+  UnlockedInsert(*table_.load(), h, std::move(value));
 }
 
-template <typename Value, typename Hash>
-void Set<Value, Hash>::FastInsert(Value&& value) {
-  auto h = hash_(value) % size_;
-  if (data_[h].head == nullptr) {
-    data_[h].head = std::make_unique<Node>(std::move(value));
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+template <typename It>
+void Set<Value, Hash, Alloc, LockPolicy>::BuildFrom(It first, It last,
+                                        uint64_t n_threads) {
+  const uint64_t n = std::distance(first, last);
+  tables_.clear();
+  tables_.push_back(std::make_unique<Table>(n / kMaxLoadFactor + 1));
+  table_.store(tables_.back().get());
+  count_ = ShardedCounter();
+  if (n == 0) {
+    return;
+  }
+  Table& table = *tables_.back();
+  if (n_threads == 0) {
+    n_threads = 1;
+  }
+  if (n_threads > table.size) {
+    n_threads = table.size;
+  }
+  if (n_threads == 1) {
+    for (It it = first; it != last; ++it) {
+      Value value = *it;
+      UnlockedInsert(table, hash_(value), std::move(value));
+    }
+    return;
+  }
+  // One hashing pass over element slices, so the bucket-partitioned fill
+  // below only compares integers for the values it does not own.
+  std::vector<uint64_t> hashes(n);
+  {
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads);
+    for (uint64_t t = 0; t < n_threads; ++t) {
+      workers.emplace_back([this, first, n, n_threads, t, &hashes]() {
+        uint64_t lo = t * n / n_threads;
+        uint64_t hi = (t + 1) * n / n_threads;
+        It it = first;
+        std::advance(it, lo);
+        for (uint64_t i = lo; i < hi; ++i, ++it) {
+          hashes[i] = hash_(*it);
+        }
+      });
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+  }
+  {
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads);
+    for (uint64_t t = 0; t < n_threads; ++t) {
+      workers.emplace_back([this, first, last, n_threads, t, &hashes,
+                            &table]() {
+        uint64_t lo = t * table.size / n_threads;
+        uint64_t hi = (t + 1) * table.size / n_threads;
+        uint64_t i = 0;
+        for (It it = first; it != last; ++it, ++i) {
+          uint64_t b = FastRange(hashes[i], table.size);
+          if (b < lo || b >= hi) {
+            continue;
+          }
+          Value value = *it;
+          UnlockedInsert(table, hashes[i], std::move(value));
+        }
+      });
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+  }
+}
+
+template <typename Value, typename Hash,
+          template <typename> typename Alloc, typename LockPolicy>
+void Set<Value, Hash, Alloc, LockPolicy>::UnlockedInsert(Table& table, uint64_t h,
+                                             Value&& value) {
+  auto& bucket = table.data[FastRange(h, table.size)];
+  if (bucket.head == nullptr) {
+    bucket.head = NodePtr(Alloc<Node>::New(h, std::move(value)));
     ++count_;
     return;
   }
-  Node* prev = data_[h].head.get();
-  if (prev->value == value) {
+  Node* prev = bucket.head.get();
+  if (prev->hash == h && prev->value == value) {
     return;
   }
-  for (Node* next = prev->next; next != nullptr;
-       prev = next, next = next->next) {
-    if (next->value == value) {
+  for (Node* next = prev->next.get(); next != nullptr;
+       prev = next, next = next->next.get()) {
+    if (next->hash == h && next->value == value) {
       return;
     }
   }
-  prev->next = std::make_unique<Node>(std::move(value));
+  prev->next = NodePtr(Alloc<Node>::New(h, std::move(value)));
   ++count_;
 }
 
@@ -0,0 +1,74 @@
+#ifndef THREADSAFE__SHARDED_COUNTER_H_
+#define THREADSAFE__SHARDED_COUNTER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Striped counter: each thread increments its own cache-line-padded stripe,
+// so hot insert/erase paths never ping-pong a shared line; Get() sums the
+// stripes. Suited to counters that are written constantly and read rarely.
+class ShardedCounter {
+ public:
+  ShardedCounter() = default;
+
+  ShardedCounter(const ShardedCounter& other) = delete;
+  ShardedCounter& operator=(const ShardedCounter& other) = delete;
+
+  // Not threadsafe.
+  ShardedCounter(ShardedCounter&& other) noexcept {
+    for (uint64_t i = 0; i < kNumStripes; ++i) {
+      stripes_[i].v.store(other.stripes_[i].v.load());
+      other.stripes_[i].v.store(0);
+    }
+  }
+  ShardedCounter& operator=(ShardedCounter&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    for (uint64_t i = 0; i < kNumStripes; ++i) {
+      stripes_[i].v.store(other.stripes_[i].v.load());
+      other.stripes_[i].v.store(0);
+    }
+    return *this;
+  }
+
+  ShardedCounter& operator++() {
+    stripes_[ThisStripe()].v.fetch_add(1, std::memory_order_relaxed);
+    return *this;
+  }
+
+  ShardedCounter& operator--() {
+    stripes_[ThisStripe()].v.fetch_sub(1, std::memory_order_relaxed);
+    return *this;
+  }
+
+  [[nodiscard]] uint64_t Get() const {
+    int64_t sum = 0;
+    for (const Stripe& stripe : stripes_) {
+      sum += stripe.v.load(std::memory_order_relaxed);
+    }
+    return static_cast<uint64_t>(sum);
+  }
+
+ private:
+  static constexpr uint64_t kNumStripes = 64;
+
+  // Individual stripes can go negative when a thread erases entries another
+  // thread inserted; only the sum is meaningful.
+  struct alignas(64) Stripe {
+    std::atomic<int64_t> v = 0;
+  };
+
+  static uint64_t ThisStripe() {
+    thread_local const uint64_t stripe =
+        next_stripe_.fetch_add(1, std::memory_order_relaxed) % kNumStripes;
+    return stripe;
+  }
+
+  static inline std::atomic<uint64_t> next_stripe_ = 0;
+
+  std::array<Stripe, kNumStripes> stripes_;
+};
+
+#endif  // THREADSAFE__SHARDED_COUNTER_H_
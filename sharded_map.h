@@ -0,0 +1,212 @@
+#ifndef THREADSAFE__SHARDED_MAP_H_
+#define THREADSAFE__SHARDED_MAP_H_
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+#include "pool_allocator.h"
+
+// N independent Maps routed by the low hash bits, so each key's bucket
+// memory and lock traffic stay inside one shard. On multi-socket machines,
+// construct with a pin callback that binds each shard's construction thread
+// to a socket: the bucket array is allocated (and first-touched) on that
+// thread, so the pages land on the local node. Size() and GetStats() fan
+// out; Resize(shard, size) migrates one shard at a time as a poor man's
+// incremental rehash of the whole map.
+template <typename Key, typename Value, uint64_t NShards = 8,
+          typename Hash = FastHash,
+          template <typename> typename Alloc = DefaultAllocator>
+class ShardedMap {
+  static_assert(NShards > 0 && std::has_single_bit(NShards),
+                "shard count must be a power of two");
+
+ public:
+  using Shard = Map<Key, Value, Hash, Alloc>;
+  // Runs on shard's construction thread before its table is allocated;
+  // pin the thread to the shard's socket here for NUMA-local buckets.
+  using PinFunc = std::function<void(uint64_t shard)>;
+
+  static constexpr uint64_t kNumShards = NShards;
+
+  explicit ShardedMap(uint64_t size_per_shard = kDefaultShardSize,
+                      PinFunc pin = nullptr);
+  ~ShardedMap() = default;
+
+  ShardedMap(const ShardedMap& other) = delete;
+  ShardedMap& operator=(const ShardedMap& other) = delete;
+
+  std::optional<Value> operator[](const Key& key) { return Find(key); }
+  std::optional<Value> Find(const Key& key) {
+    return Route(key).Find(key);
+  }
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return Route(key).Contains(key);
+  }
+  // Heterogeneous lookups, routed by the same transparent hash (see map.h).
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  std::optional<Value> Find(const K& key) {
+    return Route(key).Find(key);
+  }
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  [[nodiscard]] bool Contains(const K& key) const {
+    return Route(key).Contains(key);
+  }
+
+  template <typename Val>
+    requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
+             std::is_convertible_v<Val, Value> bool
+  Insert(const Key& key, Val&& value, bool replace = false) {
+    return Route(key).Insert(key, std::forward<Val>(value), replace);
+  }
+  template <typename... Args>
+    requires std::is_constructible_v<Value, Args&&...>
+  bool Emplace(const Key& key, Args&&... args) {
+    return Route(key).Emplace(key, std::forward<Args>(args)...);
+  }
+
+  bool Erase(const Key& key) { return Route(key).Erase(key); }
+  template <typename K>
+    requires HashableAs<K, Key, Hash>
+  bool Erase(const K& key) {
+    return Route(key).Erase(key);
+  }
+
+  // Func(val) should be threadsafe; see Map::ApplySoft.
+  template <typename Func>
+  bool ApplySoft(const Key& key, Func&& func) {
+    return Route(key).ApplySoft(key, std::forward<Func>(func));
+  }
+  template <typename Func, typename Val>
+    requires std::is_same_v<std::remove_cvref_t<Val>, Value> or
+             std::is_convertible_v<Val, Value> bool
+  Upsert(const Key& key, Func&& func, Val&& insert_val) {
+    return Route(key).Upsert(key, std::forward<Func>(func),
+                             std::forward<Val>(insert_val));
+  }
+
+  // Visits every entry shard by shard; weakly consistent per shard like
+  // Map::ForEach.
+  template <typename Func>
+  void ForEach(Func&& func) const {
+    for (const auto& shard : shards_) {
+      shard->ForEach(func);
+    }
+  }
+
+  [[nodiscard]] uint64_t Size() const;
+
+  // Migrates every shard in turn; each shard keeps serving while its
+  // migration runs (see Map::Resize).
+  void Resize(uint64_t new_size_per_shard);
+  // One shard only: spread calls over time to rehash incrementally.
+  void Resize(uint64_t shard, uint64_t new_size);
+
+  // The rest of Map's surface (Serialize, FindMany, ...) per shard.
+  Shard& GetShard(uint64_t shard) { return *shards_[shard]; }
+  const Shard& GetShard(uint64_t shard) const { return *shards_[shard]; }
+
+#ifdef THREADSAFE_STATS
+  // Merged over all shards; approximate like Map::GetStats.
+  typename Shard::Stats GetStats() const;
+#endif
+
+ private:
+  static constexpr uint64_t kDefaultShardSize = 7001;
+
+  // Low bits pick the shard: FastRange consumes the high bits for bucket
+  // indexing inside each shard, so routing and indexing draw on disjoint
+  // ends of the hash.
+  static uint64_t ShardIndex(uint64_t h) { return h & (NShards - 1); }
+  template <typename K>
+  Shard& Route(const K& key) {
+    return *shards_[ShardIndex(hash_(key))];
+  }
+  template <typename K>
+  const Shard& Route(const K& key) const {
+    return *shards_[ShardIndex(hash_(key))];
+  }
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  Hash hash_;
+};
+
+template <typename Key, typename Value, uint64_t NShards, typename Hash,
+          template <typename> typename Alloc>
+ShardedMap<Key, Value, NShards, Hash, Alloc>::ShardedMap(
+    uint64_t size_per_shard, PinFunc pin)
+    : shards_(NShards) {
+  // One construction thread per shard: with a pin callback, each bucket
+  // array is first-touched on its shard's socket.
+  std::vector<std::thread> builders;
+  builders.reserve(NShards);
+  for (uint64_t s = 0; s < NShards; ++s) {
+    builders.emplace_back([this, &pin, size_per_shard, s] {
+      if (pin) {
+        pin(s);
+      }
+      shards_[s] = std::make_unique<Shard>(size_per_shard);
+    });
+  }
+  for (auto& builder : builders) {
+    builder.join();
+  }
+}
+
+template <typename Key, typename Value, uint64_t NShards, typename Hash,
+          template <typename> typename Alloc>
+uint64_t ShardedMap<Key, Value, NShards, Hash, Alloc>::Size() const {
+  uint64_t size = 0;
+  for (const auto& shard : shards_) {
+    size += shard->Size();
+  }
+  return size;
+}
+
+template <typename Key, typename Value, uint64_t NShards, typename Hash,
+          template <typename> typename Alloc>
+void ShardedMap<Key, Value, NShards, Hash, Alloc>::Resize(
+    uint64_t new_size_per_shard) {
+  for (auto& shard : shards_) {
+    shard->Resize(new_size_per_shard);
+  }
+}
+
+template <typename Key, typename Value, uint64_t NShards, typename Hash,
+          template <typename> typename Alloc>
+void ShardedMap<Key, Value, NShards, Hash, Alloc>::Resize(uint64_t shard,
+                                                          uint64_t new_size) {
+  shards_[shard]->Resize(new_size);
+}
+
+#ifdef THREADSAFE_STATS
+template <typename Key, typename Value, uint64_t NShards, typename Hash,
+          template <typename> typename Alloc>
+typename ShardedMap<Key, Value, NShards, Hash, Alloc>::Shard::Stats
+ShardedMap<Key, Value, NShards, Hash, Alloc>::GetStats() const {
+  typename Shard::Stats stats;
+  for (const auto& shard : shards_) {
+    auto s = shard->GetStats();
+    if (s.chain_histogram.size() > stats.chain_histogram.size()) {
+      stats.chain_histogram.resize(s.chain_histogram.size());
+    }
+    for (uint64_t i = 0; i < s.chain_histogram.size(); ++i) {
+      stats.chain_histogram[i] += s.chain_histogram[i];
+    }
+    stats.max_chain = std::max(stats.max_chain, s.max_chain);
+    stats.lock_waits += s.lock_waits;
+  }
+  return stats;
+}
+#endif
+
+#endif  // THREADSAFE__SHARDED_MAP_H_
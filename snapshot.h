@@ -0,0 +1,212 @@
+#ifndef THREADSAFE__SNAPSHOT_H_
+#define THREADSAFE__SNAPSHOT_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include "hash.h"
+
+// Binary snapshot format shared by Map/Set::Serialize and the mapped views
+// below: a header, a bucket offset index (entry index per bucket,
+// prefix-summed), then the entries grouped by bucket and aligned for
+// in-place access. Entries carry their full hash, so loads never rehash —
+// which also means a snapshot must be read with the same Hash functor it
+// was written with. Version 2 groups entries with FastRange; version-1
+// files (modulo grouping) are rejected rather than misread.
+
+inline constexpr uint64_t kSnapshotMagic = 0x74736d7073686f74ULL;  // "tsmpshot"
+inline constexpr uint64_t kSnapshotVersion = 2;
+
+struct SnapshotHeader {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t buckets;
+  uint64_t entries;
+};
+
+template <typename Key, typename Value>
+struct SnapshotMapEntry {
+  uint64_t hash;
+  Key key;
+  Value val;
+};
+
+template <typename Value>
+struct SnapshotSetEntry {
+  uint64_t hash;
+  Value value;
+};
+
+constexpr uint64_t SnapshotDataOffset(uint64_t buckets, uint64_t align) {
+  uint64_t off = sizeof(SnapshotHeader) + (buckets + 1) * sizeof(uint64_t);
+  return (off + align - 1) / align * align;
+}
+
+// Owns one read-only mapping of a snapshot file; base of the map and set
+// views below.
+template <typename Entry>
+class MappedSnapshot {
+ public:
+  MappedSnapshot() = default;
+  ~MappedSnapshot() { Close(); }
+
+  MappedSnapshot(const MappedSnapshot& other) = delete;
+  MappedSnapshot& operator=(const MappedSnapshot& other) = delete;
+
+  // Maps path and validates its header; on failure the view stays closed.
+  bool Open(const std::string& path) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 ||
+        static_cast<uint64_t>(st.st_size) < sizeof(SnapshotHeader)) {
+      ::close(fd);
+      return false;
+    }
+    len_ = st.st_size;
+    base_ = ::mmap(nullptr, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base_ == MAP_FAILED) {
+      base_ = nullptr;
+      len_ = 0;
+      return false;
+    }
+    // The header fields are untrusted 64-bit counts, so the bounds checks
+    // divide instead of multiplying — a product like buckets * 8 can wrap
+    // and make a hostile file look like it fits the mapping.
+    const auto* header = static_cast<const SnapshotHeader*>(base_);
+    if (header->magic != kSnapshotMagic ||
+        header->version != kSnapshotVersion ||
+        header->buckets > (len_ - sizeof(SnapshotHeader)) / sizeof(uint64_t)) {
+      Close();
+      return false;
+    }
+    uint64_t data_off = SnapshotDataOffset(header->buckets, alignof(Entry));
+    if (data_off > len_ ||
+        header->entries > (len_ - data_off) / sizeof(Entry)) {
+      Close();
+      return false;
+    }
+    // Lookups index the entry array with [offsets[b], offsets[b + 1])
+    // unchecked, so the index is validated once here instead: it must be a
+    // non-decreasing prefix sum bounded by the entry count, or a corrupt
+    // file would walk a lookup out of the mapping.
+    const auto* offsets = reinterpret_cast<const uint64_t*>(
+        static_cast<const char*>(base_) + sizeof(SnapshotHeader));
+    uint64_t prev = 0;
+    for (uint64_t b = 0; b <= header->buckets; ++b) {
+      if (offsets[b] < prev || offsets[b] > header->entries) {
+        Close();
+        return false;
+      }
+      prev = offsets[b];
+    }
+    header_ = header;
+    offsets_ = offsets;
+    entries_ = reinterpret_cast<const Entry*>(static_cast<const char*>(base_) +
+                                              data_off);
+    return true;
+  }
+
+  void Close() {
+    if (base_ != nullptr) {
+      ::munmap(base_, len_);
+    }
+    base_ = nullptr;
+    len_ = 0;
+    header_ = nullptr;
+    offsets_ = nullptr;
+    entries_ = nullptr;
+  }
+
+  [[nodiscard]] bool Valid() const { return header_ != nullptr; }
+  [[nodiscard]] uint64_t Size() const {
+    return Valid() ? header_->entries : 0;
+  }
+
+ protected:
+  // [offsets_[b], offsets_[b + 1]) indexes bucket b's entries.
+  const SnapshotHeader* header_ = nullptr;
+  const uint64_t* offsets_ = nullptr;
+  const Entry* entries_ = nullptr;
+
+ private:
+  void* base_ = nullptr;
+  uint64_t len_ = 0;
+};
+
+// Read-only lookups served straight from a file written by Map::Serialize;
+// nothing is copied or inserted at load time.
+template <typename Key, typename Value, typename Hash = FastHash>
+class MappedMap : public MappedSnapshot<SnapshotMapEntry<Key, Value>> {
+  static_assert(std::is_trivially_copyable_v<Key>);
+  static_assert(std::is_trivially_copyable_v<Value>);
+
+ public:
+  MappedMap() = default;
+  explicit MappedMap(const std::string& path) { this->Open(path); }
+
+  std::optional<Value> Find(const Key& key) const {
+    if (!this->Valid()) {
+      return std::nullopt;
+    }
+    const uint64_t h = hash_(key);
+    const uint64_t b = FastRange(h, this->header_->buckets);
+    for (uint64_t i = this->offsets_[b]; i < this->offsets_[b + 1]; ++i) {
+      const auto& entry = this->entries_[i];
+      if (entry.hash == h && entry.key == key) {
+        return std::optional{entry.val};
+      }
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] bool Contains(const Key& key) const {
+    return Find(key) != std::nullopt;
+  }
+
+ private:
+  Hash hash_;
+};
+
+// Read-only membership checks served straight from a file written by
+// Set::Serialize.
+template <typename Value, typename Hash = FastHash>
+class MappedSet : public MappedSnapshot<SnapshotSetEntry<Value>> {
+  static_assert(std::is_trivially_copyable_v<Value>);
+
+ public:
+  MappedSet() = default;
+  explicit MappedSet(const std::string& path) { this->Open(path); }
+
+  [[nodiscard]] bool Contains(const Value& value) const {
+    if (!this->Valid()) {
+      return false;
+    }
+    const uint64_t h = hash_(value);
+    const uint64_t b = FastRange(h, this->header_->buckets);
+    for (uint64_t i = this->offsets_[b]; i < this->offsets_[b + 1]; ++i) {
+      const auto& entry = this->entries_[i];
+      if (entry.hash == h && entry.value == value) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  Hash hash_;
+};
+
+#endif  // THREADSAFE__SNAPSHOT_H_
@@ -0,0 +1,136 @@
+#ifndef THREADSAFE__WORK_STEALING_POOL_H_
+#define THREADSAFE__WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "pool_allocator.h"
+#include "queue.h"
+
+// Fans tasks out across per-worker queues so consumers stop serializing on
+// one head mutex: Submit round-robins (or routes by hint) to a shard, each
+// worker drains its own queue first and steals from the others when it runs
+// dry. Queue is FIFO from both ends, so owners and thieves both take the
+// oldest task; steals use TryPop and never block a victim.
+template <typename T, template <typename> typename Alloc = DefaultAllocator>
+class WorkStealingPool {
+ public:
+  using Handler = std::function<void(T)>;
+
+  // Spawns n_workers threads, each running handler(task); handler is called
+  // concurrently from all of them and should be threadsafe.
+  WorkStealingPool(uint64_t n_workers, Handler handler);
+  // Closes and joins; queued tasks are drained first.
+  ~WorkStealingPool() { Close(); }
+
+  WorkStealingPool(const WorkStealingPool& other) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool& other) = delete;
+
+  // Round-robins across the shards.
+  void Submit(T value);
+  // Placement hint (e.g. a key hash): tasks sharing a hint start on the
+  // same worker, though stealing may still run them elsewhere.
+  void Submit(T value, uint64_t shard);
+
+  // Stops accepting tasks, lets the workers drain what is queued, then
+  // joins them. Idempotent; called by the destructor.
+  void Close();
+
+  [[nodiscard]] uint64_t Workers() const { return queues_.size(); }
+
+ private:
+  // Idle poll period; Queue::Close wakes parked workers early anyway.
+  static constexpr std::chrono::milliseconds kIdleWait{1};
+
+  void Run(uint64_t id);
+
+  std::vector<Queue<T, Alloc>> queues_;
+  std::vector<std::thread> workers_;
+  Handler handler_;
+  std::atomic<uint64_t> next_ = 0;
+  std::atomic<bool> closed_ = false;
+};
+
+template <typename T, template <typename> typename Alloc>
+WorkStealingPool<T, Alloc>::WorkStealingPool(uint64_t n_workers,
+                                             Handler handler)
+    : queues_(n_workers == 0 ? 1 : n_workers), handler_(std::move(handler)) {
+  workers_.reserve(queues_.size());
+  for (uint64_t i = 0; i < queues_.size(); ++i) {
+    workers_.emplace_back([this, i]() { Run(i); });
+  }
+}
+
+template <typename T, template <typename> typename Alloc>
+void WorkStealingPool<T, Alloc>::Submit(T value) {
+  const uint64_t shard =
+      next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+  queues_[shard].Push(std::move(value));
+}
+
+template <typename T, template <typename> typename Alloc>
+void WorkStealingPool<T, Alloc>::Submit(T value, uint64_t shard) {
+  queues_[shard % queues_.size()].Push(std::move(value));
+}
+
+template <typename T, template <typename> typename Alloc>
+void WorkStealingPool<T, Alloc>::Close() {
+  if (closed_.exchange(true)) {
+    return;
+  }
+  for (auto& queue : queues_) {
+    queue.Close();
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+template <typename T, template <typename> typename Alloc>
+void WorkStealingPool<T, Alloc>::Run(uint64_t id) {
+  auto& own = queues_[id];
+  for (;;) {
+    if (auto task = own.TryPop()) {
+      handler_(std::move(*task));
+      continue;
+    }
+    bool stole = false;
+    for (uint64_t i = 1; i < queues_.size(); ++i) {
+      if (auto task = queues_[(id + i) % queues_.size()].TryPop()) {
+        handler_(std::move(*task));
+        stole = true;
+        break;
+      }
+    }
+    if (stole) {
+      continue;
+    }
+    if (own.Closed()) {
+      // The empty scan above ran before the flag was observed, so a task
+      // accepted in that window may still be queued anywhere. Once closed
+      // no push can land, which makes a post-close scan authoritative:
+      // exit only when it finds every queue empty.
+      bool drained = true;
+      for (uint64_t i = 0; i < queues_.size(); ++i) {
+        if (auto task = queues_[(id + i) % queues_.size()].TryPop()) {
+          handler_(std::move(*task));
+          drained = false;
+          break;
+        }
+      }
+      if (drained) {
+        return;
+      }
+      continue;
+    }
+    if (auto task = own.WaitAndPop(kIdleWait)) {
+      handler_(std::move(*task));
+    }
+  }
+}
+
+#endif  // THREADSAFE__WORK_STEALING_POOL_H_